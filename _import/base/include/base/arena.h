@@ -0,0 +1,32 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// arena class, a bump allocator for memory that is released all at once
+// memory blocks are kept over resets, so once the arena has grown to the
+// size of its largest unit of work it no longer calls the heap
+
+#pragma once
+#include "bool.h"
+
+#include <stddef.h>
+
+typedef struct arena_block_s arena_block_t;
+
+typedef struct arena_s
+{
+	arena_block_t* head;  // first block, allocation restarts here after a reset
+	arena_block_t* cur;   // block the allocations are currently served from
+	size_t pos;           // offset of the free space in 'cur'
+	int block_count;      // number of blocks allocated from the heap
+}
+arena_t;
+
+// Construction
+void     arena_init(arena_t* this_p);
+void     arena_term(arena_t* this_p);
+
+// Methods
+void*   arena_alloc(arena_t* this_p, size_t size);
+void* arena_realloc(arena_t* this_p, void* ptr, size_t old_size, size_t new_size);
+char*  arena_strdup(arena_t* this_p, char const* str, int str_len);
+void    arena_reset(arena_t* this_p);
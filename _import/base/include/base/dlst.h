@@ -2,9 +2,12 @@
 // Licensed under the MIT license.
 
 // dynamic list class of specified items
+// a list initialized with an arena allocates from it and never frees, the
+// items are still terminated with 'item_term_func'
 
 #pragma once
 #include "bool.h"
+#include "arena.h"
 
 typedef int   dlst_len_t;
 typedef void dlst_item_t;
@@ -17,11 +20,13 @@ typedef struct dlst_s
 	dlst_len_t cap;
 	dlst_len_t len;
 	dlst_item_size_t item_size;
+	arena_t* arena;
 }
 dlst_t;
 
 // Construction
 void     dlst_init(dlst_t* this_p, dlst_item_size_t item_size);
+void     dlst_init_arena(dlst_t* this_p, dlst_item_size_t item_size, arena_t* arena);
 void     dlst_term(dlst_t* this_p, dlst_item_term_func_t item_term_func);
 
 // Attributes
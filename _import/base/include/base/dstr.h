@@ -3,10 +3,12 @@
 
 #pragma once
 #include "bool.h"
+#include "arena.h"
 
 // dynamic string class
 // supports assigning and appending of different string types such as
 // string views and normal strings
+// a string initialized with an arena allocates from it and never frees
 
 typedef int  dstr_len_t;
 typedef char dstr_chr_t;
@@ -16,11 +18,13 @@ typedef struct strd_s
 	dstr_chr_t* ptr;
 	dstr_len_t cap;
 	dstr_len_t len;
+	arena_t* arena;
 }
 dstr_t;
 
 // Construction
 void     dstr_init(dstr_t* this_p);
+void     dstr_init_arena(dstr_t* this_p, arena_t* arena);
 void     dstr_term(dstr_t* this_p);
 
 // Attributes
@@ -3,8 +3,11 @@
 
 #pragma once
 #include "bool.h"
+#include "arena.h"
 
 // pointer list class
+// a list initialized with an arena allocates from it, the items it copies
+// are owned by the arena and 'item_term_func' is not called for them
 
 typedef int   plst_len_t;
 typedef void* plst_item_t;
@@ -16,11 +19,13 @@ typedef struct plst_s
 	plst_item_t* ptr;
 	plst_len_t cap;
 	plst_len_t len;
+	arena_t* arena;
 }
 plst_t;
 
 // Construction
 void     plst_init(plst_t* this_p);
+void     plst_init_arena(plst_t* this_p, arena_t* arena);
 void     plst_term(plst_t* this_p, plst_item_term_func_t item_term_func);
 
 // Attributes
@@ -2,23 +2,36 @@
 // Licensed under the MIT license.
 
 // read class for buffered IO
+// a regular file is mapped and its lines are views into the mapping, valid until
+// read_input_term(); other inputs, pipes and terminals, are read into a buffer whose
+// reads grow from read_input_buffer_MIN while they fill it, up to read_input_buffer_MAX,
+// and their lines are views into the buffer, valid until the next read_input_get_line()
+// a line keeps its '\n', except a last line without one, returned with is_eof set
+// the standard input is interactive when it is a terminal
 
 #pragma once
 
 #include "bool.h"
 #include "dstr.h"
 
-#define read_input_buffer_MAX 512
+#define read_input_buffer_MIN 4096
+#define read_input_buffer_MAX (1024 * 1024)
 
 typedef struct read_input_state_s
 {
     int fin;
     bool is_interactive;
     bool is_eof;
-    dstr_t line;
-    int  buffer_bytes;
-    int  buffer_pos;
-    char buffer[read_input_buffer_MAX];
+    bool is_mapped;         // the lines stay valid until read_input_term()
+    char const* line;       // the last line read, not terminated
+    dstr_len_t line_len;
+
+    // the mapped file, or the read buffer and its unread bytes 'buffer_pos' to 'buffer_bytes'
+    char* buffer;
+    size_t buffer_size;
+    size_t buffer_bytes;
+    size_t buffer_pos;
+    size_t read_size;       // of the next read
 }
 read_input_state_t;
 
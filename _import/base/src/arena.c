@@ -0,0 +1,146 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define arena_block_SIZE  (64 * 1024)
+#define arena_ALIGN       16
+
+struct arena_block_s
+{
+	arena_block_t* next;
+	size_t cap;
+	unsigned char data[]; // aligned to arena_ALIGN, the header is two words
+};
+
+static size_t arena_internal_align(size_t size);
+static bool arena_internal_next_block(arena_t* this_p, size_t size);
+
+void arena_init(arena_t* this_p)
+{
+	this_p->head = 0;
+	this_p->cur = 0;
+	this_p->pos = 0;
+	this_p->block_count = 0;
+}
+
+void arena_term(arena_t* this_p)
+{
+	arena_block_t* b = this_p->head;
+	while (b)
+	{
+		arena_block_t* next = b->next;
+		free(b);
+		b = next;
+	}
+
+	arena_init(this_p);
+}
+
+void* arena_alloc(arena_t* this_p, size_t size)
+{
+	size = arena_internal_align(size);
+
+	if (!this_p->cur || this_p->cur->cap - this_p->pos < size)
+	{
+		if (!arena_internal_next_block(this_p, size))
+			return 0;
+	}
+
+	void* p = this_p->cur->data + this_p->pos;
+	this_p->pos += size;
+	return p;
+}
+
+void* arena_realloc(arena_t* this_p, void* ptr, size_t old_size, size_t new_size)
+{
+	if (!ptr)
+		return arena_alloc(this_p, new_size);
+
+	// the last allocation of the current block can grow in place
+	arena_block_t* b = this_p->cur;
+	size_t old_aligned = arena_internal_align(old_size);
+	size_t new_aligned = arena_internal_align(new_size);
+	if ((unsigned char*)ptr + old_aligned == b->data + this_p->pos)
+	{
+		size_t start = this_p->pos - old_aligned;
+		if (b->cap - start >= new_aligned)
+		{
+			this_p->pos = start + new_aligned;
+			return ptr;
+		}
+	}
+
+	if (new_size <= old_size)
+		return ptr;
+
+	void* p = arena_alloc(this_p, new_size);
+	if (!p)
+		return 0;
+
+	memcpy(p, ptr, old_size);
+	return p;
+}
+
+char* arena_strdup(arena_t* this_p, char const* str, int str_len)
+{
+	char* p = arena_alloc(this_p, (str_len + 1) * sizeof(char));
+	if (!p)
+		return 0;
+
+	memcpy(p, str, str_len * sizeof(char));
+	p[str_len] = 0;
+	return p;
+}
+
+void arena_reset(arena_t* this_p)
+{
+	this_p->cur = this_p->head;
+	this_p->pos = 0;
+}
+
+// internal functions
+static size_t arena_internal_align(size_t size)
+{
+	return (size + (arena_ALIGN - 1)) & ~(size_t)(arena_ALIGN - 1);
+}
+
+static bool arena_internal_next_block(arena_t* this_p, size_t size)
+{
+	// reuse the blocks kept from before the last reset
+	arena_block_t* prev = this_p->cur;
+	arena_block_t* next = prev ? prev->next : this_p->head;
+	if (next && next->cap >= size)
+	{
+		this_p->cur = next;
+		this_p->pos = 0;
+		return true;
+	}
+
+	size_t cap = arena_block_SIZE;
+	if (cap < size)
+		cap = size;
+
+	arena_block_t* b = malloc(sizeof(arena_block_t) + cap);
+	if (!b)
+	{
+		fprintf(stderr, "No enough memory.\n");
+		return false;
+	}
+
+	b->cap = cap;
+	b->next = next;
+	if (prev)
+		prev->next = b;
+	else
+		this_p->head = b;
+
+	++(this_p->block_count);
+	this_p->cur = b;
+	this_p->pos = 0;
+	return true;
+}
@@ -16,6 +16,13 @@ void dlst_init(dlst_t* this_p, dlst_item_size_t item_size)
 	this_p->len = 0; 
 	this_p->cap = 0; 
 	this_p->item_size = item_size;
+	this_p->arena = 0;
+}
+
+void dlst_init_arena(dlst_t* this_p, dlst_item_size_t item_size, arena_t* arena)
+{
+	dlst_init(this_p, item_size);
+	this_p->arena = arena;
 }
 
 void dlst_term(dlst_t* this_p, dlst_item_term_func_t item_term_func)
@@ -34,7 +41,10 @@ void dlst_term(dlst_t* this_p, dlst_item_term_func_t item_term_func)
 		// protection against double free
 		dlst_item_t* p = this_p->ptr;
 		this_p->ptr = 0;
-		free(p);
+
+		// memory of an arena list is released by the arena
+		if (!this_p->arena)
+			free(p);
 	}
 }
 
@@ -111,7 +121,10 @@ static bool dlst_internal_realloc(dlst_t* this_p, dlst_len_t len)
 		cap = len;
 
 	size_t new_size = cap * this_p->item_size;
-	this_p->ptr = realloc(this_p->ptr, new_size);
+	if (this_p->arena)
+		this_p->ptr = arena_realloc(this_p->arena, this_p->ptr, this_p->cap * this_p->item_size, new_size);
+	else
+		this_p->ptr = realloc(this_p->ptr, new_size);
 	if (this_p->ptr == NULL)
 	{
 		fprintf(stderr, "No enough memory.\n");
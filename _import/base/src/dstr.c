@@ -16,6 +16,13 @@ void dstr_init(dstr_t* this_p)
 	this_p->ptr = 0; 
 	this_p->len = 0; 
 	this_p->cap = 0; 
+	this_p->arena = 0;
+}
+
+void dstr_init_arena(dstr_t* this_p, arena_t* arena)
+{
+	dstr_init(this_p);
+	this_p->arena = arena;
 }
 
 void dstr_term(dstr_t* this_p)
@@ -25,7 +32,10 @@ void dstr_term(dstr_t* this_p)
 		// protection against double free
 		dstr_chr_t* p = this_p->ptr;
 		this_p->ptr = 0;
-		free(p);
+
+		// memory of an arena string is released by the arena
+		if (!this_p->arena)
+			free(p);
 	}
 }
 
@@ -162,7 +172,10 @@ static bool dstr_internal_realloc(dstr_t* this_p, dstr_len_t len)
 	}
 
 	size_t new_size = cap * sizeof(dstr_chr_t);
-	this_p->ptr = realloc(this_p->ptr, new_size);
+	if (this_p->arena)
+		this_p->ptr = arena_realloc(this_p->arena, this_p->ptr, this_p->cap * sizeof(dstr_chr_t), new_size);
+	else
+		this_p->ptr = realloc(this_p->ptr, new_size);
 	if (this_p->ptr == NULL)
 	{
 		fprintf(stderr, "No enough memory.\n");
@@ -177,11 +190,18 @@ bool dstr_internal_ensure_reserve(dstr_t* this_p, dstr_len_t cap)
 	if (this_p->cap >= cap)
 		return true;
 
-	if (this_p->ptr != 0)
-		free(this_p->ptr);
-
 	size_t size = cap * sizeof(dstr_chr_t);
-	this_p->ptr = malloc(size);
+	if (this_p->arena)
+	{
+		this_p->ptr = arena_alloc(this_p->arena, size);
+	}
+	else
+	{
+		if (this_p->ptr != 0)
+			free(this_p->ptr);
+
+		this_p->ptr = malloc(size);
+	}
 	if (this_p->ptr == NULL)
 	{
 		fprintf(stderr, "Not enough memory.\n");
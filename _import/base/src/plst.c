@@ -19,12 +19,26 @@ void plst_init(plst_t* this_p)
 	this_p->ptr = 0; 
 	this_p->len = 0; 
 	this_p->cap = 0; 
+	this_p->arena = 0;
+}
+
+void plst_init_arena(plst_t* this_p, arena_t* arena)
+{
+	plst_init(this_p);
+	this_p->arena = arena;
 }
 
 void plst_term(plst_t* this_p, plst_item_term_func_t item_term_func)
 {
 	if (this_p->ptr != 0)
 	{
+		if (this_p->arena)
+		{
+			// the list and its items are released by the arena
+			this_p->ptr = 0;
+			return;
+		}
+
 		if (item_term_func)
 		{
 			for (plst_len_t i = 0; i < this_p->len; ++i)
@@ -124,7 +138,10 @@ static bool plst_internal_realloc(plst_t* this_p, plst_len_t len)
 		cap = len;
 
 	size_t new_size = cap * sizeof(plst_item_t);
-	this_p->ptr = realloc(this_p->ptr, new_size);
+	if (this_p->arena)
+		this_p->ptr = arena_realloc(this_p->arena, this_p->ptr, this_p->cap * sizeof(plst_item_t), new_size);
+	else
+		this_p->ptr = realloc(this_p->ptr, new_size);
 	if (!this_p->ptr)
 	{
 		fprintf(stderr, "No enough memory.\n");
@@ -136,6 +153,15 @@ static bool plst_internal_realloc(plst_t* this_p, plst_len_t len)
 
 bool plst_append_copy_from_view(plst_t* this_p, char const* str, int str_len)
 {
+	if (this_p->arena)
+	{
+		char* d = arena_strdup(this_p->arena, str, str_len);
+		if (!d)
+			return false;
+
+		return plst_append(this_p, d);
+	}
+
 	int l = (str_len + 1) * sizeof(char);
 	char* d = malloc(l);
 	if (!d)
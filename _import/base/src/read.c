@@ -10,6 +10,9 @@
 
 #if defined(__unix__) || defined(__CYGWIN__)
 	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#define READ_INPUT_MMAP
 #elif _WIN32
 	#include <io.h>
 #endif
@@ -28,9 +31,14 @@ void read_input_init(read_input_state_t* thip_p)
     thip_p->fin = 0;
     thip_p->is_interactive = false;
 	thip_p->is_eof = false;
-	dstr_init(&thip_p->line);
+	thip_p->is_mapped = false;
+	thip_p->line = "";
+	thip_p->line_len = 0;
+	thip_p->buffer = 0;
+	thip_p->buffer_size = 0;
     thip_p->buffer_pos = 0;
     thip_p->buffer_bytes = 0;
+	thip_p->read_size = read_input_buffer_MIN;
 }
 
 void read_input_term(read_input_state_t* thip_p)
@@ -42,7 +50,37 @@ void read_input_term(read_input_state_t* thip_p)
         close(fin);
    }
 
-   dstr_term(&thip_p->line);
+#if defined(READ_INPUT_MMAP)
+	if (thip_p->is_mapped)
+		munmap(thip_p->buffer, thip_p->buffer_size);
+	else
+#endif
+		free(thip_p->buffer);
+
+	thip_p->buffer = 0;
+	thip_p->is_mapped = false;
+}
+
+// maps a regular file whole, other files are read
+static void read_input_map(read_input_state_t* this_p)
+{
+#if defined(READ_INPUT_MMAP)
+	struct stat st;
+	if (fstat(this_p->fin, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+		return;
+
+	void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, this_p->fin, 0);
+	if (p == MAP_FAILED)
+		return;
+
+	// the lines are read once, front to back
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+	this_p->buffer = p;
+	this_p->buffer_size = st.st_size;
+	this_p->buffer_bytes = st.st_size;
+	this_p->is_mapped = true;
+#endif
 }
 
 bool read_input_open(read_input_state_t* this_p, char const* file)
@@ -56,62 +94,106 @@ bool read_input_open(read_input_state_t* this_p, char const* file)
             return false;
         }
         this_p->is_interactive = false;
+
+		read_input_map(this_p);
     }
     else
     {
+        // a pipe or a redirected file is a script streamed to the shell
         this_p->fin = 0;
-        this_p->is_interactive = true;
+        this_p->is_interactive = isatty(0);
     }
 
 	return true;
 }
 
+// makes room for a read of 'read_size' bytes after the unread ones, which are moved to
+// the front of the buffer
+static bool read_input_reserve(read_input_state_t* this_p)
+{
+	size_t unread = this_p->buffer_bytes - this_p->buffer_pos;
+	if (this_p->buffer_pos)
+	{
+		memmove(this_p->buffer, this_p->buffer + this_p->buffer_pos, unread);
+		this_p->buffer_pos = 0;
+		this_p->buffer_bytes = unread;
+	}
+
+	size_t size = unread + this_p->read_size;
+	if (size <= this_p->buffer_size)
+		return true;
+
+	char* buffer = realloc(this_p->buffer, size);
+	if (!buffer)
+	{
+		fprintf(stderr,"No enough memory.\n");
+		return false;
+	}
+
+	this_p->buffer = buffer;
+	this_p->buffer_size = size;
+	return true;
+}
+
+static void read_input_set_line(read_input_state_t* this_p, size_t end)
+{
+	this_p->line = this_p->buffer + this_p->buffer_pos;
+	this_p->line_len = (dstr_len_t)(end - this_p->buffer_pos);
+	this_p->buffer_pos = end;
+}
+
 bool read_input_get_line(read_input_state_t* this_p)
 {
-	this_p->line.len = 0;
+	this_p->line = "";
+	this_p->line_len = 0;
 
+	// the bytes before 'scanned' hold no '\n'
+	size_t scanned = this_p->buffer_pos;
 	while (true)
 	{
-		int pos;
-		for (pos = this_p->buffer_pos; pos < this_p->buffer_bytes; ++pos)
+		char const* nl = scanned < this_p->buffer_bytes
+			? memchr(this_p->buffer + scanned, '\n', this_p->buffer_bytes - scanned)
+			: 0;
+		if (nl)
 		{
-			if (this_p->buffer[pos] == '\n')
-			{
-				int l = pos - this_p->buffer_pos + 1;
-				if(!dstr_append_view(&this_p->line, this_p->buffer + this_p->buffer_pos, l))
-					return false;
-
-				this_p->buffer_pos = pos + 1;
-				return true;
-			}
+			read_input_set_line(this_p, nl - this_p->buffer + 1);
+			return true;
 		}
 
-		int l = pos - this_p->buffer_pos;
-		if (l)
+		//handle EOF
+		if (this_p->is_mapped || this_p->is_eof)
 		{
-			if(!dstr_append_view(&this_p->line, this_p->buffer + this_p->buffer_pos, l))
-				return false;
+			read_input_set_line(this_p, this_p->buffer_bytes);
+			this_p->is_eof = true;
+			return true;
 		}
 
-		this_p->buffer_pos = 0;
+		// like stdio, the output is flushed before the standard input blocks, so the
+		// driver of a streamed script sees the output of the lines it sent
+		if (this_p->fin == 0)
+			fflush(stdout);
 
 		// read input
-		if (!this_p->is_eof)
+		size_t unread = this_p->buffer_bytes - this_p->buffer_pos;
+		if (!read_input_reserve(this_p))
+			return false;
+		scanned = this_p->buffer_pos + unread;
+
+		int bytes = read(this_p->fin, this_p->buffer + this_p->buffer_bytes, (unsigned)this_p->read_size);
+		if (bytes < 0)
 		{
-			this_p->buffer_bytes = read(this_p->fin, this_p->buffer, read_input_buffer_MAX);
-			if (this_p->buffer_bytes < 0)
-			{
-				perror("read");
-				return false;
-			}
+			perror("read");
+			return false;
 		}
 
-		//handle EOF
-		if (this_p->buffer_bytes == 0)
-		{
+		if (bytes == 0)
 			this_p->is_eof = true;
-			return true;
-		}
+
+		this_p->buffer_bytes += bytes;
+
+		// a full read asks for more the next time, a terminal gives a line per read
+		if ((size_t)bytes == this_p->read_size && this_p->read_size < read_input_buffer_MAX)
+			this_p->read_size *= 2;
 	}
 
     return true;
@@ -0,0 +1,516 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "builtin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct builtin_entry_s
+{
+    char const* name;
+    builtin_t run;
+}
+builtin_entry_t;
+
+// how a '\' sequence is read: by 'echo -e', in a printf format or in a '%b' argument
+typedef enum builtin_escapes_e
+{
+    BUILTIN_ESCAPES_ECHO = 0,
+    BUILTIN_ESCAPES_FORMAT,
+    BUILTIN_ESCAPES_ARG,
+}
+builtin_escapes_t;
+
+static bool builtin_is_octal(char c)
+{
+    return c >= '0' && c <= '7';
+}
+
+static int builtin_hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// a lone '--help' or '--version' prints the text of the utility
+static bool builtin_is_help(char* const* argv)
+{
+    return argv[1] && !argv[2] && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "--version") == 0);
+}
+
+static int builtin_no_memory(void)
+{
+    fprintf(stderr,"No enough memory.\n");
+    return EXIT_FAILURE;
+}
+
+// appends the character of the escape after the '\' at 'p' and returns what follows it,
+// 0 for an escape left to the utility; '\c' sets 'is_stopped', nothing more is printed
+static char const* builtin_escape(char const* p, builtin_escapes_t escapes, dstr_t* out, bool* result, bool* is_stopped)
+{
+    static char const letters[] = "\\abefnrtv";
+    static char const values[] = "\\\a\b\033\f\n\r\t\v";
+
+    char const* letter = *p ? strchr(letters, *p) : 0;
+    if (letter)
+    {
+        *result = *result && dstr_append_chr(out, values[letter - letters]);
+        return p + 1;
+    }
+
+    if (*p == 'c')
+    {
+        *is_stopped = true;
+        return p + 1;
+    }
+
+    if (*p == '"' && escapes != BUILTIN_ESCAPES_ECHO)
+    {
+        *result = *result && dstr_append_chr(out, '"');
+        return p + 1;
+    }
+
+    if (*p == 'x' && builtin_hex_value(p[1]) >= 0)
+    {
+        int value = builtin_hex_value(p[1]);
+        p += 2;
+        if (builtin_hex_value(*p) >= 0)
+            value = value * 16 + builtin_hex_value(*p++);
+
+        *result = *result && dstr_append_chr(out, (char)value);
+        return p;
+    }
+
+    // printf fails on a '\x' without digits, and prints unicode escapes in the locale
+    if ((*p == 'x' || *p == 'u' || *p == 'U') && escapes != BUILTIN_ESCAPES_ECHO)
+        return 0;
+
+    if (builtin_is_octal(*p))
+    {
+        // up to 3 digits, after the '0' of '\0' for echo and '%b'
+        if (*p == '0' && escapes != BUILTIN_ESCAPES_FORMAT)
+            ++p;
+
+        int value = 0;
+        for (int i = 0; i < 3 && builtin_is_octal(*p); ++i)
+            value = value * 8 + (*p++ - '0');
+
+        *result = *result && dstr_append_chr(out, (char)value);
+        return p;
+    }
+
+    // not an escape, printed as it is
+    *result = *result && dstr_append_chr(out, '\\');
+    if (*p)
+        *result = *result && dstr_append_chr(out, *p++);
+    return p;
+}
+
+// appends 'str' with its escapes translated, 0 for an escape left to the utility
+static bool builtin_escapes(char const* str, builtin_escapes_t escapes, dstr_t* out, bool* result, bool* is_stopped)
+{
+    while (*str && !*is_stopped)
+    {
+        char const* bs = strchr(str, '\\');
+        size_t len = bs ? (size_t)(bs - str) : strlen(str);
+        *result = *result && dstr_append_view(out, str, len);
+        if (!bs)
+            break;
+
+        str = builtin_escape(bs + 1, escapes, out, result, is_stopped);
+        if (!str)
+            return false;
+    }
+
+    return true;
+}
+
+static int builtin_true(char* const* argv, dstr_t* out)
+{
+    (void)out;
+    return builtin_is_help(argv) ? builtin_DECLINED : EXIT_SUCCESS;
+}
+
+static int builtin_false(char* const* argv, dstr_t* out)
+{
+    (void)out;
+    return builtin_is_help(argv) ? builtin_DECLINED : EXIT_FAILURE;
+}
+
+static int builtin_echo(char* const* argv, dstr_t* out)
+{
+    // POSIXLY_CORRECT changes how GNU echo reads its options
+    if (builtin_is_help(argv) || getenv("POSIXLY_CORRECT"))
+        return builtin_DECLINED;
+
+    // the leading arguments made of '-' and 'n', 'e' or 'E' only are options
+    bool is_newline = true;
+    bool is_escapes = false;
+    char* const* arg = argv + 1;
+    for (; *arg && (*arg)[0] == '-' && (*arg)[1]; ++arg)
+    {
+        if ((*arg)[1 + strspn(*arg + 1, "neE")])
+            break;
+
+        for (char const* p = *arg + 1; *p; ++p)
+        {
+            if (*p == 'n')
+                is_newline = false;
+            else
+                is_escapes = *p == 'e';
+        }
+    }
+
+    bool result = true;
+    bool is_stopped = false;
+    for (char* const* first = arg; *arg && !is_stopped; ++arg)
+    {
+        if (arg != first)
+            result = result && dstr_append_chr(out, ' ');
+
+        if (is_escapes)
+            builtin_escapes(*arg, BUILTIN_ESCAPES_ECHO, out, &result, &is_stopped);
+        else
+            result = result && dstr_append_str(out, *arg);
+    }
+
+    if (is_newline && !is_stopped)
+        result = result && dstr_append_chr(out, '\n');
+
+    return result ? EXIT_SUCCESS : builtin_no_memory();
+}
+
+// printf
+
+// the value of a numeric argument, false for one printf reports as an error
+static bool builtin_printf_number(char const* arg, bool is_signed, intmax_t* value)
+{
+    // a leading quote gives the code of the character after it
+    if (arg[0] == '\'' || arg[0] == '"')
+    {
+        if (arg[1] && arg[2])
+            return false;
+
+        *value = (unsigned char)arg[1];
+        return true;
+    }
+
+    char* end;
+    errno = 0;
+    *value = is_signed ? strtoimax(arg, &end, 0) : (intmax_t)strtoumax(arg, &end, 0);
+    return end != arg && !*end && !errno;
+}
+
+// appends a conversion, 'spec' is its text from the '%' with room for the 'j' of intmax_t
+static bool builtin_printf_convert(char* spec, size_t spec_len, char conversion, char const* arg, dstr_t* out, bool* result)
+{
+    if (conversion == 's' && spec_len == 1)
+    {
+        *result = *result && dstr_append_str(out, arg);
+        return true;
+    }
+
+    char buf[512];
+    int len;
+    if (conversion == 's' || conversion == 'c')
+    {
+        spec[spec_len] = conversion;
+        spec[spec_len + 1] = 0;
+        len = conversion == 's' ? snprintf(buf, sizeof(buf), spec, arg) : snprintf(buf, sizeof(buf), spec, arg[0]);
+    }
+    else
+    {
+        intmax_t value = 0;
+        bool is_signed = conversion == 'd' || conversion == 'i';
+        if (*arg && !builtin_printf_number(arg, is_signed, &value))
+            return false;
+
+        spec[spec_len] = 'j';
+        spec[spec_len + 1] = conversion;
+        spec[spec_len + 2] = 0;
+        len = is_signed ? snprintf(buf, sizeof(buf), spec, value) : snprintf(buf, sizeof(buf), spec, (uintmax_t)value);
+    }
+
+    // a wide field does not fit the buffer
+    if (len < 0 || (size_t)len >= sizeof(buf))
+        return false;
+
+    *result = *result && dstr_append_view(out, buf, len);
+    return true;
+}
+
+// prints the format once with the arguments from 'args', returns how many of them it
+// used, or -1 for a format left to the utility
+static int builtin_printf_format(char const* p, char* const* args, dstr_t* out, bool* result, bool* is_stopped)
+{
+    int used = 0;
+    while (*p && !*is_stopped)
+    {
+        size_t len = strcspn(p, "%\\");
+        *result = *result && dstr_append_view(out, p, len);
+        p += len;
+
+        if (*p == '\\')
+        {
+            p = builtin_escape(p + 1, BUILTIN_ESCAPES_FORMAT, out, result, is_stopped);
+            if (!p)
+                return -1;
+            continue;
+        }
+
+        if (!*p)
+            break;
+
+        if (p[1] == '%')
+        {
+            *result = *result && dstr_append_chr(out, '%');
+            p += 2;
+            continue;
+        }
+
+        // flags, width and precision; '*' and the ' flag are left to the utility
+        char const* start = p++;
+        p += strspn(p, "-+ #0");
+        p += strspn(p, "0123456789");
+        if (*p == '.')
+        {
+            ++p;
+            p += strspn(p, "0123456789");
+        }
+
+        char conversion = *p;
+        if (!conversion || !strchr("diouxXcsb", conversion))
+            return -1;
+
+        char const* arg = args[used] ? args[used] : "";
+        if (args[used])
+            ++used;
+        ++p;
+
+        if (conversion == 'b')
+        {
+            if (p - start != 2 || !builtin_escapes(arg, BUILTIN_ESCAPES_ARG, out, result, is_stopped))
+                return -1;
+            continue;
+        }
+
+        char spec[64];
+        size_t spec_len = (size_t)(p - 1 - start);
+        if (spec_len + 3 > sizeof(spec))
+            return -1;
+
+        memcpy(spec, start, spec_len);
+        if (!builtin_printf_convert(spec, spec_len, conversion, arg, out, result))
+            return -1;
+    }
+
+    return used;
+}
+
+static int builtin_printf(char* const* argv, dstr_t* out)
+{
+    if (!argv[1] || builtin_is_help(argv))
+        return builtin_DECLINED;
+
+    // the format is repeated while it uses arguments and some are left
+    bool result = true;
+    bool is_stopped = false;
+    char* const* args = argv + 2;
+    do
+    {
+        int used = builtin_printf_format(argv[1], args, out, &result, &is_stopped);
+
+        // printf warns about the arguments a format without conversions ignores
+        if (used < 0 || (used == 0 && *args && args == argv + 2))
+            return builtin_DECLINED;
+
+        args += used;
+        if (!used)
+            break;
+    }
+    while (*args && !is_stopped);
+
+    return result ? EXIT_SUCCESS : builtin_no_memory();
+}
+
+// test
+
+// an integer operand, false for one test reports as an error
+static bool builtin_test_integer(char const* arg, long long* value)
+{
+    char* end;
+    errno = 0;
+    *value = strtoll(arg, &end, 10);
+    if (end == arg || errno || !(end[-1] >= '0' && end[-1] <= '9'))
+        return false;
+
+    end += strspn(end, " \t\n\v\f\r");
+    return !*end;
+}
+
+// 1 true, 0 false, -1 for an operator left to the utility
+static int builtin_test_unary(char const* op, char const* arg)
+{
+    if (op[0] != '-' || !op[1] || op[2])
+        return -1;
+
+    struct stat st;
+    switch (op[1])
+    {
+        case 'z': return !*arg;
+        case 'n': return *arg != 0;
+        case 'e': return stat(arg, &st) == 0;
+        case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+        case 'b': return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+        case 'c': return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+        case 'p': return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+        case 'S': return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+        case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+        case 'h':
+        case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        default: break;
+    }
+
+    return -1;
+}
+
+static bool builtin_test_is_binary(char const* op)
+{
+    static char const* const ops[] = { "=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-a", "-o" };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i)
+    {
+        if (strcmp(op, ops[i]) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static int builtin_test_binary(char const* left, char const* op, char const* right)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(left, right) != 0;
+    if (strcmp(op, "-a") == 0)
+        return *left && *right;
+    if (strcmp(op, "-o") == 0)
+        return *left || *right;
+
+    long long l, r;
+    if (!builtin_test_integer(left, &l) || !builtin_test_integer(right, &r))
+        return -1;
+
+    if (strcmp(op, "-eq") == 0)
+        return l == r;
+    if (strcmp(op, "-ne") == 0)
+        return l != r;
+    if (strcmp(op, "-lt") == 0)
+        return l < r;
+    if (strcmp(op, "-le") == 0)
+        return l <= r;
+    if (strcmp(op, "-gt") == 0)
+        return l > r;
+    return l >= r;
+}
+
+// the expressions of up to 4 arguments, as POSIX reads them; -1 for one left to the utility
+static int builtin_test_expression(char* const* argv, int argc)
+{
+    int value;
+    switch (argc)
+    {
+        case 0:
+            return 0;
+        case 1:
+            return argv[0][0] != 0;
+        case 2:
+            if (strcmp(argv[0], "!") == 0)
+                return !argv[1][0];
+            return builtin_test_unary(argv[0], argv[1]);
+        case 3:
+            if (builtin_test_is_binary(argv[1]))
+                return builtin_test_binary(argv[0], argv[1], argv[2]);
+            if (strcmp(argv[0], "!") == 0)
+                return (value = builtin_test_expression(argv + 1, 2)) < 0 ? -1 : !value;
+            if (strcmp(argv[0], "(") == 0 && strcmp(argv[2], ")") == 0)
+                return argv[1][0] != 0;
+            return -1;
+        case 4:
+            if (strcmp(argv[0], "!") == 0)
+                return (value = builtin_test_expression(argv + 1, 3)) < 0 ? -1 : !value;
+            if (strcmp(argv[0], "(") == 0 && strcmp(argv[3], ")") == 0)
+                return builtin_test_expression(argv + 1, 2);
+            return -1;
+        default:
+            break;
+    }
+
+    return -1;
+}
+
+static int builtin_test(char* const* argv, dstr_t* out)
+{
+    (void)out;
+
+    int argc = 0;
+    while (argv[argc + 1])
+        ++argc;
+
+    int value = builtin_test_expression(argv + 1, argc);
+    if (value < 0)
+        return builtin_DECLINED;
+
+    return value ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int builtin_pwd(char* const* argv, dstr_t* out)
+{
+    (void)argv;
+
+    char* cwd = getcwd(NULL, 0);
+    if (!cwd)
+    {
+        fprintf(stderr, "error: pwd: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    bool result = dstr_append_str(out, cwd) && dstr_append_chr(out, '\n');
+    free(cwd);
+    return result ? EXIT_SUCCESS : builtin_no_memory();
+}
+
+static builtin_entry_t const builtin_table[] =
+{
+    { "echo",   builtin_echo },
+    { "false",  builtin_false },
+    { "printf", builtin_printf },
+    { "test",   builtin_test },
+    { "true",   builtin_true },
+};
+
+builtin_t builtin_find(char const* name)
+{
+    for (size_t i = 0; i < sizeof(builtin_table) / sizeof(builtin_table[0]); ++i)
+    {
+        if (strcmp(name, builtin_table[i].name) == 0)
+            return builtin_table[i].run;
+    }
+
+    return 0;
+}
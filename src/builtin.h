@@ -0,0 +1,26 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+#include "base/dstr.h"
+
+// common utilities run inside the shell instead of being launched: echo, true, false,
+// test and printf, with the behavior of their GNU versions
+// a utility gets the argv of the command after the expansion of the wildcards, appends
+// what it prints to 'out' and returns its exit code; it does not read its input, so the
+// shell writes 'out' where the output of the command goes once the utility returned
+// for arguments a utility does not handle, e.g. a '%f' conversion of printf or one the
+// GNU version reports as an error, it returns builtin_DECLINED; 'out' is then dropped and
+// the command is launched as usual
+
+#define builtin_DECLINED (-1)
+
+typedef int (*builtin_t)(char* const* argv, dstr_t* out);
+
+// returns the utility of a bare command name, 0 if it is not a builtin
+builtin_t builtin_find(char const* name);
+
+// the output of the 'pwd' builtin, for a pwd whose output is not the shell's
+int builtin_pwd(char* const* argv, dstr_t* out);
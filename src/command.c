@@ -5,6 +5,8 @@
 #include "base/dstr.h"
 #include "base/dlst.h"
 #include "glob.h"
+#include "pathcache.h"
+#include "builtin.h"
 
 #include <stdio.h>
 #include <errno.h>
@@ -12,45 +14,78 @@
 
 #if defined(__unix__) || defined(__CYGWIN__)
 	#include <unistd.h>
+	#include <spawn.h>
 	#include <sys/wait.h>
+	#include <sys/resource.h>
 #elif _WIN32
 	#include <io.h>
 #endif
 
 #include <string.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #if (_MSC_VER >= 1400)
 #pragma warning(disable: 4996) // disabling deprecation for msvc
 #endif
 
-void command_init(command_t* this_p)
+extern char** environ;
+
+typedef struct command_launcher_stats_s
+{
+    long launches;
+    long long elapsed_ns; // time spent inside fork()/posix_spawn() by the parent
+}
+command_launcher_stats_t;
+
+static command_launcher_t command_launcher = COMMAND_LAUNCHER_SPAWN;
+static command_launcher_stats_t command_launcher_stats[2];
+
+typedef struct command_builtin_stats_s
+{
+    long in_process;    // run and written by the shell
+    long forked;        // run by the shell, written to a pipe by a child
+    long declined;      // launched for arguments the builtin leaves to the utility
+}
+command_builtin_stats_t;
+
+static command_builtin_stats_t command_builtin_stats;
+
+// number of batches run at once when an argument list is over the system limit,
+// 0 leaves the list whole and its launch fails with E2BIG
+static int command_batch_jobs = 0;
+
+// the matches of an argument of the command in its expansion
+typedef struct command_arg_range_s
+{
+    size_t first;
+    size_t count;
+    bool is_expanded;   // matches of a pattern, split over the batches; otherwise repeated in each
+}
+command_arg_range_t;
+
+void command_init(command_t* this_p, arena_t* arena)
 {
     this_p->command_type = COMMAND_NONE;
-    dstr_init(&(this_p->executable));
-    plst_init(&(this_p->args));
-    dstr_init(&(this_p->redir_in_from));
-    dstr_init(&(this_p->redir_out_to));
+    dstr_init_arena(&(this_p->executable), arena);
+    plst_init_arena(&(this_p->args), arena);
+    dstr_init_arena(&(this_p->redir_in_from), arena);
+    dstr_init_arena(&(this_p->redir_out_to), arena);
 
-    dstr_init(&(this_p->executable_path_resolved));
-    plst_init(&(this_p->args_glob_refined));
+    dstr_init_arena(&(this_p->executable_path_resolved), arena);
+    plst_init_arena(&(this_p->args_glob_refined), arena);
     this_p->pid = 0;
     this_p->pipe_in = 0;
     this_p->pipe_out = 0;
+    this_p->pipe_peer = 0;
     this_p->exit_code = 0;
-}
-
-void command_term(command_t* this_p)
-{
-    dstr_term(&(this_p->executable));
-    plst_term(&(this_p->args), (plst_item_term_func_t)free);
-    dstr_term(&(this_p->redir_in_from));
-    dstr_term(&(this_p->redir_out_to));
-
-    dstr_term(&(this_p->executable_path_resolved));
-    plst_term(&(this_p->args_glob_refined), (plst_item_term_func_t)free);
+    this_p->is_run = false;
+    this_p->status = 0;
+    this_p->user_us = 0;
+    this_p->sys_us = 0;
 }
 
 static char const* command_get_executable(command_t const* c)
@@ -76,11 +111,59 @@ static bool command_exec_sys_error_msg(command_t const* c, char const* str_error
 }
 
 static bool command_exec_builtin_cd  (command_t const* c, command_exec_status_t* exec_status);
-static bool command_exec_builtin_pwd (command_t const* c, command_exec_status_t* exec_status);
+static bool command_exec_builtin_pwd (command_t* c, command_exec_status_t* exec_status);
 static bool command_exec_builtin_exit(command_t const* c, command_exec_status_t* exec_status);
+static bool command_exec_builtin_hash(command_t* c, command_exec_status_t* exec_status);
 static bool command_exec_external    (command_t* c, command_exec_status_t* exec_status);
+static bool command_exec_external_fork (command_t* c, command_exec_status_t* exec_status, int* child_pid);
+static bool command_exec_external_spawn(command_t* c, command_exec_status_t* exec_status, int* child_pid);
+static bool command_exec_external_expanded(command_t* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count, command_exec_status_t* exec_status);
+static bool command_exec_external_batched(command_t* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count, command_exec_status_t* exec_status);
+static bool command_batch_is_needed(command_t const* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count);
 
-static bool command_exec(command_t* c, command_exec_status_t* exec_status)
+static long long command_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// the exit status of a command from its wait status
+int command_status_code(int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return EXIT_FAILURE;
+}
+
+// waits for a child of the pipeline and records its status and times in its command,
+// returns the pid or -1
+static int command_wait(dlst_t* command_pipeline, int* wait_status)
+{
+    struct rusage usage;
+    int pid = wait4(-1, wait_status, 0, &usage);
+    if (pid <= 0)
+        return pid;
+
+    for (dlst_len_t j = 0; j < command_pipeline->len; ++j)
+    {
+        command_t* cmd = dlst_at(command_pipeline, j);
+        if (cmd->pid == pid)
+        {
+            cmd->exit_code = *wait_status;
+            cmd->status = command_status_code(*wait_status);
+            cmd->user_us = usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec;
+            cmd->sys_us = usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec;
+            break;
+        }
+    }
+
+    return pid;
+}
+
+static bool command_exec_dispatch(command_t* c, command_exec_status_t* exec_status)
 {
     switch(c->command_type)
     {
@@ -90,6 +173,8 @@ static bool command_exec(command_t* c, command_exec_status_t* exec_status)
             return command_exec_builtin_pwd(c, exec_status);
         case COMMAND_BUILTIN_EXIT:
             return command_exec_builtin_exit(c, exec_status);
+        case COMMAND_BUILTIN_HASH:
+            return command_exec_builtin_hash(c, exec_status);
         case COMMAND_EXTERNAL:
             return command_exec_external(c, exec_status);
         default:
@@ -101,6 +186,121 @@ static bool command_exec(command_t* c, command_exec_status_t* exec_status)
     return false;
 }
 
+static bool command_exec(command_t* c, command_exec_status_t* exec_status)
+{
+    bool result = command_exec_dispatch(c, exec_status);
+
+    // a builtin is done when it returns, an external command when it is waited for
+    c->is_run = true;
+    if (c->command_type != COMMAND_EXTERNAL || !result)
+        c->status = exec_status->code;
+    else if (!c->pid)
+        c->status = command_status_code(c->exit_code);
+
+    return result;
+}
+
+static bool command_write_all(int fd, char const* ptr, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = write(fd, ptr, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return false;
+
+        ptr += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+// writes the output of a builtin that ran in the shell where the output of the command
+// goes: its '> file', the pipe to the next command or the standard output of the shell;
+// the redirections are opened as the launchers open them, a failure is reported the same
+// way; an output that does not fit the empty pipe is written by a child, the shell would
+// block on it before the reader is launched
+// 'c->exit_code' is the status the command would be waited for with
+static bool command_builtin_output(command_t* c, dstr_t const* out, int code, command_exec_status_t* exec_status)
+{
+    int fd = STDOUT_FILENO;
+    int err = 0;
+    if (!dstr_is_null(&c->redir_out_to))
+    {
+        fd = open(c->redir_out_to.ptr, O_WRONLY|O_TRUNC|O_CREAT|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP);
+        if (fd == -1)
+            err = errno;
+    }
+    else if (c->pipe_out)
+        fd = c->pipe_out;
+
+    if (!err && !dstr_is_null(&c->redir_in_from))
+    {
+        int fin = open(c->redir_in_from.ptr, O_RDONLY|O_CLOEXEC);
+        if (fin == -1)
+            err = errno;
+        else
+            close(fin);
+    }
+
+    if (err)
+    {
+        if (fd != -1 && fd != STDOUT_FILENO && fd != c->pipe_out)
+            close(fd);
+
+        command_exec_sys_error_msg(c, strerror(err));
+        c->exit_code = (err & 0xff) << 8;
+        exec_status->code = c->exit_code;
+        return true;
+    }
+
+    if (fd == c->pipe_out && out->len > PIPE_BUF)
+    {
+        // the buffered output of the shell must not be written twice
+        fflush(stdout);
+        fflush(stderr);
+
+        int pid = fork();
+        if (pid == -1)
+        {
+            exec_status->code = errno;
+            command_exec_sys_error_msg(c, strerror(errno));
+            return false;
+        }
+
+        if (pid == 0)
+        {
+            // a reader that went away stops the child by SIGPIPE; the child holds no
+            // other end of the pipes of the pipeline
+            if (c->pipe_peer)
+                close(c->pipe_peer);
+            if (c->pipe_in)
+                close(c->pipe_in);
+            _exit(command_write_all(fd, out->ptr, out->len) ? code : EXIT_FAILURE);
+        }
+
+        c->pid = pid;
+        ++(exec_status->wait_count);
+        ++command_builtin_stats.forked;
+        return true;
+    }
+
+    if (out->len && !command_write_all(fd, out->ptr, out->len))
+    {
+        command_exec_sys_error_msg(c, strerror(errno));
+        code = EXIT_FAILURE;
+    }
+
+    if (fd != STDOUT_FILENO && fd != c->pipe_out)
+        close(fd);
+
+    c->exit_code = (code & 0xff) << 8;
+    ++command_builtin_stats.in_process;
+    return true;
+}
+
 static bool command_exec_builtin_cd_internal(command_t const* c, char const* path, command_exec_status_t* exec_status)
 {
     int res = chdir(path);
@@ -145,7 +345,7 @@ static bool command_exec_builtin_cd(command_t const* c, command_exec_status_t* e
     return command_exec_builtin_cd_internal(c, (char const*)(c->args.ptr[0]), exec_status);
 }
 
-static bool command_exec_builtin_pwd(command_t const* c, command_exec_status_t* exec_status)
+static bool command_exec_builtin_pwd(command_t* c, command_exec_status_t* exec_status)
 {
     if (plst_length(&c->args) > 0)
     {
@@ -154,6 +354,21 @@ static bool command_exec_builtin_pwd(command_t const* c, command_exec_status_t*
         return false;
     }
 
+    // the output of a pwd in a pipeline or redirected is not the shell's
+    if (c->pipe_out || !dstr_is_null(&c->redir_out_to))
+    {
+        dstr_t out;
+        dstr_init(&out);
+
+        char* const argv[] = { "pwd", 0 };
+        int code = builtin_pwd(argv, &out);
+        exec_status->code = code;
+
+        bool result = code == 0 && command_builtin_output(c, &out, code, exec_status);
+        dstr_term(&out);
+        return result;
+    }
+
     char* cwd = getcwd(NULL, 0);
     if(cwd == NULL)
     {
@@ -201,10 +416,55 @@ static bool command_exec_builtin_exit(command_t const* c, command_exec_status_t*
     return true;
 }
 
+static bool command_exec_builtin_hash(command_t* c, command_exec_status_t* exec_status)
+{
+    exec_status->code = 0;
+
+    dstr_t out;
+    dstr_init(&out);
+
+    // 'hash' lists the cache, 'hash -r' clears it and 'hash name...' primes it
+    if (plst_is_null(&c->args) && !path_cache_print(&out))
+        exec_status->code = -1;
+
+    for (plst_len_t i = 0; i < plst_length(&c->args); ++i)
+    {
+        char const* name = c->args.ptr[i];
+        if (strcmp(name, "-r") == 0)
+        {
+            path_cache_clear();
+            continue;
+        }
+
+        dstr_t resolved;
+        dstr_init(&resolved);
+        bool found = !strchr(name, '/') && path_cache_lookup(name, &resolved);
+        dstr_term(&resolved);
+
+        if (!found)
+        {
+            fprintf(stderr, "error: %s: %s: not found\n", c->executable.ptr, name);
+            exec_status->code = 1;
+        }
+    }
+
+    bool result = exec_status->code == 0;
+
+    // the output of a hash in a pipeline or redirected is not the shell's, as for pwd
+    if (result && (c->pipe_out || !dstr_is_null(&c->redir_out_to)))
+        result = command_builtin_output(c, &out, 0, exec_status);
+    else if (result && out.len)
+        printf("%.*s", out.len, out.ptr);
+
+    dstr_term(&out);
+    return result;
+}
+
 static bool command_exec_external_check_prefix(char const* prefix, char const* cmd, dstr_t* cmd_resolved)
 {
+    // allocate from the same place as the result
     dstr_t path;
-    dstr_init(&path);
+    dstr_init_arena(&path, cmd_resolved->arena);
     if(prefix)
         dstr_assign_str(&path, prefix);
     dstr_append_str(&path, cmd);
@@ -227,25 +487,7 @@ static bool command_exec_external_search(char const* cmd, dstr_t* cmd_resolved)
         return false;
     }
 
-    if(command_exec_external_check_prefix("/usr/local/sbin/", cmd, cmd_resolved))
-        return true;
-    
-    if(command_exec_external_check_prefix("/usr/local/bin/", cmd, cmd_resolved))
-        return true;
-
-    if(command_exec_external_check_prefix("/usr/sbin/", cmd, cmd_resolved))
-        return true;
-
-    if(command_exec_external_check_prefix("/usr/bin/", cmd, cmd_resolved))
-        return true;        
-
-    if(command_exec_external_check_prefix("/sbin/", cmd, cmd_resolved))
-        return true;
-
-    if(command_exec_external_check_prefix("/bin/", cmd, cmd_resolved))
-        return true;
-
-    return false;
+    return path_cache_lookup(cmd, cmd_resolved);
 }
 
 static bool command_exec_external(command_t* c, command_exec_status_t* exec_status)
@@ -258,37 +500,136 @@ static bool command_exec_external(command_t* c, command_exec_status_t* exec_stat
         return false;
     }
 
-    if (!plst_append_copy_from_str(&c->args_glob_refined, c->args.ptr[0]))
+    // refine args with wildcard expansion, all the patterns are expanded together
+    // so a directory several of them start from is read once; the matches are kept
+    // compact, their paths are built only for the argv of the command
+    int pattern_count = c->args.len - 1;
+    size_t firsts[pattern_count + 1];
+    command_arg_range_t ranges[pattern_count ? pattern_count : 1];
+
+    glob_result_t expansion;
+    glob_result_init(&expansion);
+
+    if (pattern_count && (!glob_expand((char const* const*)c->args.ptr + 1, pattern_count, &expansion)
+        || !glob_result_group_by_tag(&expansion, pattern_count, firsts)))
+    {
+        glob_result_term(&expansion);
+        exec_status->code = 1;
         return false;
-    
-    // refine args with wildcard expansion
-    for (plst_len_t i = 1; i < c->args.len; ++i)
-	{
-		char const* f = c->args.ptr[i];
-        plst_len_t added = 0;
-        if (!glob_append(f, &c->args_glob_refined, &added))
-            return false;
+    }
+
+    for (int i = 0; i < pattern_count; ++i)
+    {
+        ranges[i].first = firsts[i];
+        ranges[i].count = firsts[i + 1] - firsts[i];
+        ranges[i].is_expanded = ranges[i].count != 0;
+    }
 
-        if (!added)
+    bool result = command_exec_external_expanded(c, &expansion, ranges, pattern_count, exec_status);
+
+    glob_result_term(&expansion);
+    return result;
+}
+
+// builds the argv of the command from its arguments and the matches 'first_file' to
+// 'end_file' of its expansion, the arguments without matches are kept as they are
+static bool command_args_build(command_t const* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count, size_t first_file, size_t end_file, plst_t* argv)
+{
+    bool result = plst_append_copy_from_str(argv, c->args.ptr[0]);
+    for (int i = 0; result && i < range_count; ++i)
+    {
+        command_arg_range_t const* range = &ranges[i];
+        if (!range->is_expanded)
         {
-            if (!plst_append_copy_from_str(&c->args_glob_refined, f))
-                return false;
+            result = plst_append_copy_from_str(argv, c->args.ptr[i + 1]);
+            continue;
         }
-	}
 
-    if (!plst_append_zero(&c->args_glob_refined))
-        return false;
+        size_t first = range->first > first_file ? range->first : first_file;
+        size_t end = range->first + range->count < end_file ? range->first + range->count : end_file;
+        if (first < end)
+            result = glob_result_paths_append(expansion, first, end - first, argv);
+    }
+
+    return result && plst_append_zero(argv);
+}
 
-    if(!command_exec_external_check_prefix(0, c->executable.ptr, &c->executable_path_resolved))
+// runs a builtin utility with the expanded arguments of the command, false if it left
+// them to the utility it stands for
+static bool command_exec_builtin_utility(command_t* c, builtin_t builtin, bool* result, command_exec_status_t* exec_status)
+{
+    dstr_t out;
+    dstr_init(&out);
+
+    int code = builtin((char* const*)c->args_glob_refined.ptr, &out);
+    if (code != builtin_DECLINED)
     {
-        if(!command_exec_external_search(c->executable.ptr, &c->executable_path_resolved))
-        {
-            exec_status->code = -1;
-            command_exec_sys_error_msg(c, "No such external command");
+        *result = command_builtin_output(c, &out, code, exec_status);
+        if (*result && !c->pid)
+            exec_status->code = c->exit_code;
+    }
+
+    dstr_term(&out);
+    return code != builtin_DECLINED;
+}
+
+static bool command_exec_external_expanded(command_t* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count, command_exec_status_t* exec_status)
+{
+    // bare names of builtin utilities run in the shell
+    builtin_t builtin = strchr(c->executable.ptr, '/') ? 0 : builtin_find(c->executable.ptr);
+    if (builtin)
+    {
+        if (!command_args_build(c, expansion, ranges, range_count, 0, expansion->file_count, &c->args_glob_refined))
             return false;
-        }
+
+        bool result;
+        if (command_exec_builtin_utility(c, builtin, &result, exec_status))
+            return result;
+
+        c->args_glob_refined.len = 0;
+        ++command_builtin_stats.declined;
+    }
+
+    // names with a slash are used as given, bare names are searched in $PATH
+    bool is_resolved = strchr(c->executable.ptr, '/')
+        ? command_exec_external_check_prefix(0, c->executable.ptr, &c->executable_path_resolved)
+        : command_exec_external_search(c->executable.ptr, &c->executable_path_resolved);
+
+    if (!is_resolved)
+    {
+        exec_status->code = -1;
+        command_exec_sys_error_msg(c, "No such external command");
+        return false;
     }
 
+    if (command_batch_jobs && command_batch_is_needed(c, expansion, ranges, range_count))
+        return command_exec_external_batched(c, expansion, ranges, range_count, exec_status);
+
+    if (!command_args_build(c, expansion, ranges, range_count, 0, expansion->file_count, &c->args_glob_refined))
+        return false;
+
+    int pid = 0;
+    long long launch_start_ns = command_clock_ns();
+
+    bool result = (command_launcher == COMMAND_LAUNCHER_FORK)
+        ? command_exec_external_fork(c, exec_status, &pid)
+        : command_exec_external_spawn(c, exec_status, &pid);
+
+    command_launcher_stats_t* stats = &command_launcher_stats[command_launcher];
+    stats->elapsed_ns += command_clock_ns() - launch_start_ns;
+    ++(stats->launches);
+
+    if (!result)
+        return false;
+
+    c->pid = pid;
+    if (pid)
+        ++(exec_status->wait_count);
+    return true;
+}
+
+static bool command_exec_external_fork(command_t* c, command_exec_status_t* exec_status, int* child_pid)
+{
 	int pid = fork();
     if (pid == -1)
     {
@@ -298,8 +639,7 @@ static bool command_exec_external(command_t* c, command_exec_status_t* exec_stat
         return false;
     }
 
-    c->pid = pid;
-	if (c->pid == 0)
+	if (pid == 0)
     {
         int child_exit_code = 0;
 
@@ -345,23 +685,308 @@ static bool command_exec_external(command_t* c, command_exec_status_t* exec_stat
             close(c->pipe_in);
         }
 
-		// must use execv, because the number of arguments is dynamic
-		execvp(c->executable_path_resolved.ptr, (char * const*)c->args_glob_refined.ptr);
+		// the path is already resolved, no need for execvp() to search $PATH again
+		execve(c->executable_path_resolved.ptr, (char * const*)c->args_glob_refined.ptr, environ);
        	
         child_exit_code = errno;
         if (!child_exit_code)
             child_exit_code = EXIT_FAILURE;
 
-        command_exec_external_echo("execvp", c);
+        command_exec_external_echo("execve", c);
         printf(" : abnormally exited with code %d\n", child_exit_code);
         exit(child_exit_code);
         return false; // unreacheable code
 	}
 
+    *child_pid = pid;
+    return true;
+}
+
+static bool command_exec_external_spawn(command_t* c, command_exec_status_t* exec_status, int* child_pid)
+{
+    // the same redirections as the fork() path performs in the child, expressed as file
+    // actions so that the C library can use vfork()/clone(CLONE_VM|CLONE_VFORK) and skip
+    // copying the page tables of the shell
+    posix_spawn_file_actions_t actions;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err)
+    {
+        exec_status->code = err;
+        command_exec_sys_error_msg(c, strerror(err));
+        return false;
+    }
+
+    if (!dstr_is_null(&c->redir_out_to))
+    {
+        err = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, c->redir_out_to.ptr, O_WRONLY|O_TRUNC|O_CREAT, S_IRUSR|S_IWUSR|S_IRGRP);
+    }
+    else if (c->pipe_out)
+    {
+        err = posix_spawn_file_actions_adddup2(&actions, c->pipe_out, STDOUT_FILENO);
+        if (!err)
+            err = posix_spawn_file_actions_addclose(&actions, c->pipe_out);
+    }
+
+    if (!err)
+    {
+        if (!dstr_is_null(&c->redir_in_from))
+        {
+            err = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, c->redir_in_from.ptr, O_RDONLY, 0);
+        }
+        else if (c->pipe_in)
+        {
+            err = posix_spawn_file_actions_adddup2(&actions, c->pipe_in, STDIN_FILENO);
+            if (!err)
+                err = posix_spawn_file_actions_addclose(&actions, c->pipe_in);
+        }
+    }
+
+    pid_t pid = 0;
+    if (!err)
+        err = posix_spawn(&pid, c->executable_path_resolved.ptr, &actions, 0, (char * const*)c->args_glob_refined.ptr, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err)
+    {
+        // the fork() path reports redirection and exec failures from the child which then
+        // exits with errno; keep the same observable status so that '||' and '&&' behave alike
+        command_exec_sys_error_msg(c, strerror(err));
+        c->exit_code = (err & 0xff) << 8;
+        exec_status->code = c->exit_code;
+        *child_pid = 0;
+        return true;
+    }
+
+    *child_pid = pid;
+    return true;
+}
+
+// argument batching
+// an argument list over the system limit is run as several commands, like xargs does:
+// the matches of the patterns are split over the batches, every other argument is
+// repeated in each; the batches are run by a helper process, so a pipeline stage keeps
+// a single pid, and the helper exits with the status of the first batch that failed
+
+static long command_batch_arg_size(char const* arg)
+{
+    return strlen(arg) + 1 + sizeof(char*);
+}
+
+static long command_batch_file_size(glob_result_t const* expansion, size_t file)
+{
+    return glob_result_path_len(expansion, file) + 1 + sizeof(char*);
+}
+
+// the space for argv, the environment is passed to the command too and POSIX asks
+// to leave 2048 bytes of headroom
+static long command_batch_limit(void)
+{
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0)
+        arg_max = 4096;
+
+    long env_size = sizeof(char*);
+    for (char** e = environ; *e; ++e)
+        env_size += command_batch_arg_size(*e);
+
+    return arg_max - env_size - 2048;
+}
+
+// the size of the argv is found from the expansion, before any path is built
+static bool command_batch_is_needed(command_t const* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count)
+{
+    long size = sizeof(char*) + command_batch_arg_size(c->args.ptr[0]);
+    for (int i = 0; i < range_count; ++i)
+    {
+        if (!ranges[i].is_expanded)
+            size += command_batch_arg_size(c->args.ptr[i + 1]);
+    }
+
+    for (size_t i = 0; i < expansion->file_count; ++i)
+        size += command_batch_file_size(expansion, i);
+
+    return size > command_batch_limit();
+}
+
+// runs in the helper process, returns its exit code; the argv of a batch is built
+// from the expansion when the batch is launched
+static int command_batch_run(command_t* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count)
+{
+    // redirections are opened once for all the batches, so '> file' is not truncated by each
+    if (!dstr_is_null(&c->redir_out_to))
+    {
+        int fout = open(c->redir_out_to.ptr, O_WRONLY|O_TRUNC|O_CREAT, S_IRUSR|S_IWUSR|S_IRGRP);
+        if (fout == -1)
+        {
+            command_exec_sys_error_msg(c, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        c->pipe_out = fout;
+        dstr_init(&c->redir_out_to);
+    }
+
+    if (!dstr_is_null(&c->redir_in_from))
+    {
+        int fin = open(c->redir_in_from.ptr, O_RDONLY);
+        if (fin == -1)
+        {
+            command_exec_sys_error_msg(c, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        c->pipe_in = fin;
+        dstr_init(&c->redir_in_from);
+    }
+
+    // the matches are split over the batches, the other arguments are in every batch
+    long fixed_size = sizeof(char*) + command_batch_arg_size(c->args.ptr[0]);
+    for (int i = 0; i < range_count; ++i)
+    {
+        if (!ranges[i].is_expanded)
+            fixed_size += command_batch_arg_size(c->args.ptr[i + 1]);
+    }
+
+    long limit = command_batch_limit();
+
+    // the paths of a batch are released when the next one is built
+    arena_t arena;
+    arena_init(&arena);
+    plst_t argv;
+
+    int jobs = command_batch_jobs;
+    pid_t running_pids[jobs];
+    int running_batches[jobs];
+    int running = 0;
+
+    int batch = 0;
+    int failed_batch = -1;
+    int failed_code = 0;
+    size_t file_count = expansion->file_count;
+    size_t next = 0;
+    bool result = true;
+
+    while (true)
+    {
+        if (result && next < file_count && running < jobs)
+        {
+            // as many of the matches as fit next to the repeated arguments
+            long size = fixed_size;
+            size_t end = next;
+            for (; end < file_count; ++end)
+            {
+                long arg_size = command_batch_file_size(expansion, end);
+                if (size + arg_size > limit && end > next)
+                    break;
+                size += arg_size;
+            }
+
+            if (size > limit)
+            {
+                command_exec_sys_error_msg(c, strerror(E2BIG));
+                result = false;
+                continue;
+            }
+
+            arena_reset(&arena);
+            plst_init_arena(&argv, &arena);
+            result = command_args_build(c, expansion, ranges, range_count, next, end, &argv);
+            if (!result)
+                continue;
+
+            c->args_glob_refined = argv;
+
+            int pid = 0;
+            command_exec_status_t exec_status = { 0 };
+            c->exit_code = 0;
+            result = (command_launcher == COMMAND_LAUNCHER_FORK)
+                ? command_exec_external_fork(c, &exec_status, &pid)
+                : command_exec_external_spawn(c, &exec_status, &pid);
+
+            if (result && !pid && c->exit_code && failed_batch < 0)
+            {
+                // the launch failed, it was reported already
+                failed_batch = batch;
+                failed_code = command_status_code(c->exit_code);
+            }
+            else if (result && pid)
+            {
+                running_pids[running] = pid;
+                running_batches[running] = batch;
+                ++running;
+            }
+
+            ++batch;
+            next = end;
+            continue;
+        }
+
+        if (!running)
+            break;
+
+        int status = 0;
+        pid_t pid = wait(&status);
+        if (pid <= 0)
+            break;
+
+        for (int i = 0; i < running; ++i)
+        {
+            if (running_pids[i] != pid)
+                continue;
+
+            int code = command_status_code(status);
+            if (code && (failed_batch < 0 || running_batches[i] < failed_batch))
+            {
+                failed_batch = running_batches[i];
+                failed_code = code;
+            }
+
+            --running;
+            running_pids[i] = running_pids[running];
+            running_batches[i] = running_batches[running];
+            break;
+        }
+    }
+
+    arena_term(&arena);
+
+    if (!result)
+        return failed_code ? failed_code : EXIT_FAILURE;
+
+    return failed_code;
+}
+
+static bool command_exec_external_batched(command_t* c, glob_result_t const* expansion, command_arg_range_t const* ranges, int range_count, command_exec_status_t* exec_status)
+{
+    // the buffered output of the shell must not be written twice
+    fflush(stdout);
+    fflush(stderr);
+
+    int pid = fork();
+    if (pid == -1)
+    {
+        exec_status->code = errno;
+        command_exec_sys_error_msg(c, strerror(errno));
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        // the helper does not exec, the read end of its output is closed by hand
+        if (c->pipe_peer)
+            close(c->pipe_peer);
+        _exit(command_batch_run(c, expansion, ranges, range_count));
+    }
+
+    c->pid = pid;
     ++(exec_status->wait_count);
     return true;
 }
 
+void command_batch_set(int jobs)
+{
+    command_batch_jobs = jobs;
+}
+
 bool command_pileline_exec(dlst_t* command_pipeline, command_exec_status_t* exec_status)
 {
     exec_status->wait_count = 0;
@@ -372,7 +997,8 @@ bool command_pileline_exec(dlst_t* command_pipeline, command_exec_status_t* exec
         if (!command_exec(cmd, exec_status))
 			return false;
 
-		wait(&exec_status->code);
+        if (exec_status->wait_count)
+		    command_wait(command_pipeline, &exec_status->code);
 		return true;
     }
 
@@ -390,7 +1016,14 @@ bool command_pileline_exec(dlst_t* command_pipeline, command_exec_status_t* exec
             return false;
         }
 
+        // the commands get their ends as stdin/stdout, the other pipe ends of the
+        // pipeline must not stay open in them or a reader never sees the end of input
+        // and a writer is never stopped by SIGPIPE
+        fcntl(p[0], F_SETFD, FD_CLOEXEC);
+        fcntl(p[1], F_SETFD, FD_CLOEXEC);
+
         cmd->pipe_out = p[1];
+        cmd->pipe_peer = p[0];
         cmd->pipe_in = prev_pipe_out;
         prev_pipe_out = p[0];
 
@@ -406,6 +1039,7 @@ bool command_pileline_exec(dlst_t* command_pipeline, command_exec_status_t* exec
     command_t* last_cmd = dlst_at(command_pipeline, command_pipeline->len - 1);
     last_cmd->pipe_in = prev_pipe_out;
     last_cmd->pipe_out = 0;
+    last_cmd->pipe_peer = 0;
     if (!command_exec(last_cmd, exec_status))
         return false;
 
@@ -417,93 +1051,14 @@ bool command_pileline_exec(dlst_t* command_pipeline, command_exec_status_t* exec
     for (dlst_len_t i = 0; i < exec_status->wait_count; ++i)
 	{
         int exit_code = 0;
-        int pid = wait(&exit_code);
-        if (pid <= 0)
+        if (command_wait(command_pipeline, &exit_code) <= 0)
             break;
-
-        for (dlst_len_t j = 0; j < command_pipeline->len; ++j)
-        {
-            command_t* cmd = dlst_at(command_pipeline, j);
-            if (cmd->pid == pid)
-            {
-                cmd->exit_code = exit_code;
-                break;
-            }
-        }
     }
 
     exec_status->code = last_cmd->exit_code;
     return true;
 }
 
-void command_node_type_check_fail(command_combine_type_t command_combine_type)
-{
-    fprintf(stderr, "Unexpected error: invalid combine type '%d'\n", command_combine_type);
-}
-
-bool command_node_exec(command_node_t* this_p, command_exec_status_t* exec_status)
-{
-    switch (this_p->combine_type)
-    {
-        case COMMAND_COMBINE_PIPE:
-            return command_pileline_exec(&this_p->pileline, exec_status);
-        
-        case COMMAND_COMBINE_AND:
-        {
-            if (!command_node_exec(this_p->left, exec_status))
-                return false;
-
-            if (exec_status->code != 0)
-                return true;
-
-            return command_node_exec(this_p->right, exec_status);
-        }
-        case COMMAND_COMBINE_OR:
-        {
-            if (!command_node_exec(this_p->left, exec_status))
-                return false;
-
-            if (exec_status->code != 0)
-                return command_node_exec(this_p->right, exec_status);
-
-            return true;
-        }
-        default:
-            break;
-    }
-
-    command_node_type_check_fail(this_p->combine_type);
-    exec_status->code = 1;
-    return false;
-}
-
-void command_term(command_t* this_p);
-
-void command_node_term(command_node_t* this_p)
-{
-    switch (this_p->combine_type)
-    {
-        case COMMAND_COMBINE_PIPE:
-        {
-            dlst_term(&this_p->pileline, (dlst_item_term_func_t)command_term);
-            break;
-        }
-        
-        case COMMAND_COMBINE_AND:
-        case COMMAND_COMBINE_OR:
-        {
-            command_node_term(this_p->left);
-            command_node_term(this_p->right);
-            break;
-        }
-        default:
-            command_node_type_check_fail(this_p->combine_type);
-            break;
-    }
-
-    free(this_p);
-}
-
 void command_exec_external_echo(char const* prefix, command_t const* c)
 {
     char const* executable = command_get_executable(c);
@@ -527,3 +1082,42 @@ void command_exec_external_echo(char const* prefix, command_t const* c)
         printf(" > '%s'", c->redir_out_to.ptr);
     }
 }
+
+
+void command_launcher_set(command_launcher_t launcher)
+{
+    command_launcher = launcher;
+}
+
+bool command_launcher_set_by_name(char const* name)
+{
+    if (strcmp(name, "spawn") == 0)
+        command_launcher_set(COMMAND_LAUNCHER_SPAWN);
+    else if (strcmp(name, "fork") == 0)
+        command_launcher_set(COMMAND_LAUNCHER_FORK);
+    else
+        return false;
+
+    return true;
+}
+
+void command_launcher_stats_print(void)
+{
+    static char const* const names[] = { "spawn", "fork" };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        command_launcher_stats_t const* stats = &command_launcher_stats[i];
+        if (!stats->launches)
+            continue;
+
+        double seconds = stats->elapsed_ns / 1e9;
+        double rate = seconds > 0 ? stats->launches / seconds : 0;
+        fprintf(stderr, "launcher %-5s: %ld processes in %.6f s (%.0f spawns/sec)\n", names[i], stats->launches, seconds, rate);
+    }
+
+    command_builtin_stats_t const* builtins = &command_builtin_stats;
+    if (builtins->in_process || builtins->forked || builtins->declined)
+        fprintf(stderr, "builtins      : %ld run in the shell, %ld written by a child, %ld launched\n",
+            builtins->in_process, builtins->forked, builtins->declined);
+}
\ No newline at end of file
@@ -14,7 +14,8 @@ typedef enum command_type_e
 	COMMAND_EXTERNAL,
 	COMMAND_BUILTIN_CD,
 	COMMAND_BUILTIN_PWD,
-	COMMAND_BUILTIN_EXIT
+	COMMAND_BUILTIN_EXIT,
+	COMMAND_BUILTIN_HASH
 }
 command_type_t;
 
@@ -34,7 +35,14 @@ typedef struct command_s
 	int pid;
 	int pipe_in;
 	int pipe_out;
+	int pipe_peer; // the read end of the pipe of 'pipe_out', which the next command reads
 	int exit_code;
+
+	// the outcome of the run, reported with --results-fd
+	bool is_run;
+	int status;         // the exit status as a shell reports it, 128 + the signal of a killed command
+	long long user_us;  // cpu time of the process
+	long long sys_us;
 }
 command_t;
 
@@ -47,36 +55,12 @@ typedef enum command_combine_type_e
 }
 command_combine_type_t;
 
-typedef struct command_node_s command_node_t;
-
-typedef struct command_node_s
+typedef enum command_launcher_e
 {
-	command_combine_type_t combine_type;
-
-	union
-	{
-		struct // valid if combine_type == AND || combine_type == OR
-		{
-			command_node_t* left;
-			command_node_t* right;
-		};
-
-		struct // valid if combine_type == PIPE
-		{
-			union
-			{
-				dlst_t pileline; 
-				struct // for debug viewing
-				{
-					command_t* dbg_pileline_ptr;
-					dlst_len_t dbg_pileline_cap;
-					dlst_len_t dbg_pileline_len;
-				};
-			};
-		};
-	};
+	COMMAND_LAUNCHER_SPAWN = 0, // posix_spawn(), redirections as spawn file actions
+	COMMAND_LAUNCHER_FORK,      // fork() + exec(), redirections done in the child
 }
-command_node_t;
+command_launcher_t;
 
 typedef struct command_exec_status_s
 {
@@ -86,7 +70,23 @@ typedef struct command_exec_status_s
 }
 command_exec_status_t;
 
+// the strings of the command are allocated from 'arena'
+void command_init(command_t* this_p, arena_t* arena);
+
 void command_exec_external_echo(char const* prefix, command_t const* c);
 
-bool command_node_exec(command_node_t* this_p, command_exec_status_t* exec_status);
-void command_node_term(command_node_t* this_p);
+void command_launcher_set(command_launcher_t launcher);
+bool command_launcher_set_by_name(char const* name);
+void command_launcher_stats_print(void);
+
+// with 'jobs' > 0 a command whose expanded argument list is over the system limit
+// is run in batches, up to 'jobs' of them at once; 0 turns batching off
+void command_batch_set(int jobs);
+
+// the exit status of a command as a shell reports it from its wait() status: its exit
+// code, or 128 + the signal that killed it
+int command_status_code(int wait_status);
+
+// runs the commands of 'command_pipeline', each one reading the output of the one before
+// it; the status is the one of the last command
+bool command_pileline_exec(dlst_t* command_pipeline, command_exec_status_t* exec_status);
@@ -0,0 +1,446 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#if defined(__unix__) || defined(__CYGWIN__)
+	// enable openat() when using glibc
+	#define _DEFAULT_SOURCE
+	#define _ATFILE_SOURCE
+#endif
+
+#include "dircache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__linux__)
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+	#include <sys/inotify.h>
+#endif
+
+typedef struct dir_cache_entry_s dir_cache_entry_t;
+
+struct dir_cache_entry_s
+{
+    dir_listing_t listing;  // first, a listing pointer is an entry pointer
+    unsigned long long dev;
+    unsigned long long ino;
+    int wd;                       // inotify watch, -1 for a listing that is not cached
+    int pins;                     // acquired and not released yet
+    bool is_stale;                // dropped from the cache while pinned
+    size_t bytes;                 // accounted against the budget
+    dir_cache_entry_t* next_key;  // chain of the bucket of (dev, ino)
+    dir_cache_entry_t* next_wd;   // chain of the bucket of wd
+    dir_cache_entry_t* lru_prev;  // more recently used
+    dir_cache_entry_t* lru_next;  // less recently used
+};
+
+typedef struct dir_cache_s
+{
+    bool is_enabled;
+    int inotify_fd;
+    size_t budget;
+    size_t bytes;
+    int len;
+    int bucket_count;               // power of 2, both tables have the same size
+    dir_cache_entry_t** key_buckets;
+    dir_cache_entry_t** wd_buckets;
+    dir_cache_entry_t* lru_head;
+    dir_cache_entry_t* lru_tail;
+    long hits;
+    long misses;
+    long invalidations;
+    long evictions;
+}
+dir_cache_t;
+
+static dir_cache_t cache = { 0 };
+
+#if defined(__linux__)
+
+static unsigned dir_cache_key_hash(unsigned long long dev, unsigned long long ino)
+{
+    unsigned long long h = (ino ^ (dev << 32) ^ dev) * 0x9e3779b97f4a7c15ull;
+    return (unsigned)(h >> 32);
+}
+
+static unsigned dir_cache_wd_hash(int wd)
+{
+    return (unsigned)wd * 2654435761u;
+}
+
+static dir_cache_entry_t** dir_cache_key_bucket(unsigned long long dev, unsigned long long ino)
+{
+    return &cache.key_buckets[dir_cache_key_hash(dev, ino) & (cache.bucket_count - 1)];
+}
+
+static dir_cache_entry_t** dir_cache_wd_bucket(int wd)
+{
+    return &cache.wd_buckets[dir_cache_wd_hash(wd) & (cache.bucket_count - 1)];
+}
+
+static bool dir_cache_rehash(int bucket_count)
+{
+    dir_cache_entry_t** key_buckets = calloc(bucket_count, sizeof(dir_cache_entry_t*));
+    dir_cache_entry_t** wd_buckets = calloc(bucket_count, sizeof(dir_cache_entry_t*));
+    if (!key_buckets || !wd_buckets)
+    {
+        free(key_buckets);
+        free(wd_buckets);
+        fprintf(stderr, "No enough memory.\n");
+        return false;
+    }
+
+    free(cache.key_buckets);
+    free(cache.wd_buckets);
+    cache.key_buckets = key_buckets;
+    cache.wd_buckets = wd_buckets;
+    cache.bucket_count = bucket_count;
+
+    // every cached entry is on the LRU list
+    for (dir_cache_entry_t* e = cache.lru_head; e; e = e->lru_next)
+    {
+        dir_cache_entry_t** b = dir_cache_key_bucket(e->dev, e->ino);
+        e->next_key = *b;
+        *b = e;
+
+        b = dir_cache_wd_bucket(e->wd);
+        e->next_wd = *b;
+        *b = e;
+    }
+
+    return true;
+}
+
+static void dir_cache_lru_unlink(dir_cache_entry_t* e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        cache.lru_head = e->lru_next;
+
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        cache.lru_tail = e->lru_prev;
+
+    e->lru_prev = 0;
+    e->lru_next = 0;
+}
+
+static void dir_cache_lru_push_front(dir_cache_entry_t* e)
+{
+    e->lru_prev = 0;
+    e->lru_next = cache.lru_head;
+    if (cache.lru_head)
+        cache.lru_head->lru_prev = e;
+    else
+        cache.lru_tail = e;
+    cache.lru_head = e;
+}
+
+static void dir_cache_entry_free(dir_cache_entry_t* e)
+{
+    dir_listing_term(&e->listing);
+    free(e);
+}
+
+// takes 'e' out of the cache; the watch is removed unless the kernel already did
+static void dir_cache_remove(dir_cache_entry_t* e, bool rm_watch)
+{
+    dir_cache_entry_t** p = dir_cache_key_bucket(e->dev, e->ino);
+    while (*p != e)
+        p = &(*p)->next_key;
+    *p = e->next_key;
+
+    p = dir_cache_wd_bucket(e->wd);
+    while (*p != e)
+        p = &(*p)->next_wd;
+    *p = e->next_wd;
+
+    dir_cache_lru_unlink(e);
+
+    if (rm_watch)
+        inotify_rm_watch(cache.inotify_fd, e->wd);
+
+    cache.bytes -= e->bytes;
+    --cache.len;
+    e->wd = -1;
+
+    if (e->pins)
+        e->is_stale = true;
+    else
+        dir_cache_entry_free(e);
+}
+
+static dir_cache_entry_t* dir_cache_find(unsigned long long dev, unsigned long long ino)
+{
+    dir_cache_entry_t* e = *dir_cache_key_bucket(dev, ino);
+    while (e && (e->dev != dev || e->ino != ino))
+        e = e->next_key;
+    return e;
+}
+
+static dir_cache_entry_t* dir_cache_find_wd(int wd)
+{
+    dir_cache_entry_t* e = *dir_cache_wd_bucket(wd);
+    while (e && e->wd != wd)
+        e = e->next_wd;
+    return e;
+}
+
+static void dir_cache_clear(void)
+{
+    while (cache.lru_head)
+        dir_cache_remove(cache.lru_head, true);
+}
+
+// applies the changes the kernel reported since the last call
+static void dir_cache_drain_events(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        ssize_t n = read(cache.inotify_fd, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+
+        for (char* p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+        {
+            struct inotify_event const* ev = (struct inotify_event const*)p;
+            if (ev->mask & IN_Q_OVERFLOW)
+            {
+                // events were lost, nothing can be trusted
+                cache.invalidations += cache.len;
+                dir_cache_clear();
+                continue;
+            }
+
+            // events of an evicted watch can still be queued, they match no entry
+            dir_cache_entry_t* e = dir_cache_find_wd(ev->wd);
+            if (e)
+            {
+                ++cache.invalidations;
+                dir_cache_remove(e, !(ev->mask & IN_IGNORED));
+            }
+        }
+    }
+}
+
+static bool dir_cache_read(int dfd, dir_listing_t* listing)
+{
+    if (!dir_scan_read(dfd, listing))
+        return false;
+
+    // the budget accounts for the bytes used, the slack is given back
+    char* names = listing->size ? realloc(listing->names, listing->size) : 0;
+    if (names)
+        listing->names = names;
+
+    return true;
+}
+
+// evicts the least recently used listings until the cache fits the budget
+static void dir_cache_shrink(void)
+{
+    dir_cache_entry_t* e = cache.lru_tail;
+    while (e && cache.bytes > cache.budget)
+    {
+        dir_cache_entry_t* prev = e->lru_prev;
+        if (!e->pins)
+        {
+            ++cache.evictions;
+            dir_cache_remove(e, true);
+        }
+        e = prev;
+    }
+}
+
+bool dir_cache_enable(size_t budget)
+{
+    if (cache.is_enabled)
+    {
+        cache.budget = budget;
+        dir_cache_shrink();
+        return true;
+    }
+
+    cache.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cache.inotify_fd == -1)
+    {
+        perror("inotify");
+        return false;
+    }
+
+    if (!dir_cache_rehash(256))
+    {
+        close(cache.inotify_fd);
+        return false;
+    }
+
+    cache.budget = budget;
+    cache.is_enabled = true;
+    return true;
+}
+
+void dir_cache_term(void)
+{
+    if (!cache.is_enabled)
+        return;
+
+    dir_cache_clear();
+    close(cache.inotify_fd);
+    free(cache.key_buckets);
+    free(cache.wd_buckets);
+    cache.key_buckets = 0;
+    cache.wd_buckets = 0;
+    cache.bucket_count = 0;
+    cache.is_enabled = false;
+}
+
+dir_listing_t* dir_cache_acquire(int dfd)
+{
+    struct stat stat_struct;
+    if (fstat(dfd, &stat_struct) != 0)
+        return 0;
+
+    dir_cache_drain_events();
+
+    dir_cache_entry_t* e = dir_cache_find(stat_struct.st_dev, stat_struct.st_ino);
+    if (e)
+    {
+        ++cache.hits;
+        dir_cache_lru_unlink(e);
+        dir_cache_lru_push_front(e);
+        ++(e->pins);
+        return &e->listing;
+    }
+
+    ++cache.misses;
+
+    e = calloc(1, sizeof(dir_cache_entry_t));
+    if (!e)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return 0;
+    }
+
+    e->dev = stat_struct.st_dev;
+    e->ino = stat_struct.st_ino;
+    e->pins = 1;
+
+    // the watch is set before the directory is read, so no change can slip in between
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", dfd);
+    e->wd = inotify_add_watch(cache.inotify_fd, proc_path,
+        IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+    if (!dir_cache_read(dfd, &e->listing))
+    {
+        if (e->wd != -1)
+            inotify_rm_watch(cache.inotify_fd, e->wd);
+        free(e);
+        return 0;
+    }
+
+    e->bytes = sizeof(dir_cache_entry_t) + e->listing.size;
+
+    // the watch limit is reached or the listing alone is over the budget, the
+    // listing is handed out uncached and freed on release
+    if (e->wd == -1 || e->bytes > cache.budget)
+    {
+        if (e->wd != -1)
+            inotify_rm_watch(cache.inotify_fd, e->wd);
+        e->wd = -1;
+        e->is_stale = true;
+        return &e->listing;
+    }
+
+    // inotify hands out the existing watch of an inode; should another entry still
+    // hold it, the listing is kept out of the cache as their events could not be told apart
+    if (dir_cache_find_wd(e->wd))
+    {
+        e->is_stale = true;
+        return &e->listing;
+    }
+
+    if (cache.len + 1 > cache.bucket_count && !dir_cache_rehash(cache.bucket_count * 2))
+    {
+        inotify_rm_watch(cache.inotify_fd, e->wd);
+        e->wd = -1;
+        e->is_stale = true;
+        return &e->listing;
+    }
+
+    dir_cache_entry_t** b = dir_cache_key_bucket(e->dev, e->ino);
+    e->next_key = *b;
+    *b = e;
+
+    b = dir_cache_wd_bucket(e->wd);
+    e->next_wd = *b;
+    *b = e;
+
+    dir_cache_lru_push_front(e);
+    cache.bytes += e->bytes;
+    ++cache.len;
+
+    dir_cache_shrink();
+    return &e->listing;
+}
+
+void dir_cache_release(dir_listing_t* listing)
+{
+    dir_cache_entry_t* e = (dir_cache_entry_t*)listing;
+    if (--(e->pins) == 0 && e->is_stale)
+    {
+        dir_cache_entry_free(e);
+        return;
+    }
+
+    // pinned listings could not be evicted when the budget was exceeded
+    if (cache.bytes > cache.budget)
+        dir_cache_shrink();
+}
+
+#else // no inotify
+
+bool dir_cache_enable(size_t budget)
+{
+    fprintf(stderr, "error: the directory cache is not supported on this system\n");
+    return false;
+}
+
+void dir_cache_term(void)
+{
+}
+
+dir_listing_t* dir_cache_acquire(int dfd)
+{
+    return 0;
+}
+
+void dir_cache_release(dir_listing_t* listing)
+{
+}
+
+#endif
+
+bool dir_cache_is_enabled(void)
+{
+    return cache.is_enabled;
+}
+
+void dir_cache_stats_print(void)
+{
+    if (!cache.is_enabled)
+    {
+        fprintf(stderr, "dir cache     : disabled\n");
+        return;
+    }
+
+    fprintf(stderr, "dir cache     : %d entries, %zu of %zu bytes, %ld hits, %ld misses, %ld invalidations, %ld evictions\n",
+        cache.len, cache.bytes, cache.budget, cache.hits, cache.misses, cache.invalidations, cache.evictions);
+}
@@ -0,0 +1,29 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+#include "dirscan.h"
+
+#include <stddef.h>
+
+// cache of directory listings (entry names and types) for the glob expansion
+// a listing is kept coherent by an inotify watch on its directory: any entry created,
+// deleted or renamed drops it; listings are evicted least recently used first when
+// their total size exceeds the memory budget
+// the cache is off until dir_cache_enable() is called and is used from one thread
+
+#define dir_cache_BUDGET_DEFAULT (16 * 1024 * 1024)
+
+bool dir_cache_enable(size_t budget);
+bool dir_cache_is_enabled(void);
+void dir_cache_term(void);
+
+// returns the listing of the directory open as 'dfd', which stays valid until it is
+// released even if the directory changes meanwhile; 0 on a failure
+// the caller may resolve DT_UNKNOWN types in place, they are kept for the next users
+dir_listing_t* dir_cache_acquire(int dfd);
+void           dir_cache_release(dir_listing_t* listing);
+
+void dir_cache_stats_print(void);
@@ -0,0 +1,441 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#if defined(__unix__) || defined(__CYGWIN__)
+	// enable fdopendir(), fstatat(), statx() and DT_DIR when using glibc
+	#define _GNU_SOURCE
+#endif
+
+#include "dirscan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+	#include <sys/syscall.h>
+	#include <sys/mman.h>
+	#include <linux/io_uring.h>
+#endif
+
+#define dir_scan_BUFFER_SIZE   (32 * 1024)
+#define dir_scan_RING_ENTRIES  64
+#define dir_scan_RING_MIN      4     // fewer entries are resolved synchronously
+
+typedef struct dir_scan_stats_s
+{
+    atomic_long directories;
+    atomic_long unknown_resolved_ring;
+    atomic_long unknown_resolved_sync;
+    atomic_long unknown_retried;        // failed in io_uring, resolved synchronously again
+}
+dir_scan_stats_t;
+
+static dir_scan_stats_t stats;
+
+static bool dir_scan_listing_reserve(dir_listing_t* listing, size_t* cap, size_t size)
+{
+    if (listing->size + size <= *cap)
+        return true;
+
+    size_t new_cap = *cap ? *cap * 2 : 1024;
+    while (new_cap < listing->size + size)
+        new_cap *= 2;
+
+    char* names = realloc(listing->names, new_cap);
+    if (!names)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return false;
+    }
+
+    listing->names = names;
+    *cap = new_cap;
+    return true;
+}
+
+static bool dir_scan_listing_append(dir_listing_t* listing, size_t* cap, unsigned char d_type, char const* name)
+{
+    size_t l = strlen(name) + 2;
+    if (!dir_scan_listing_reserve(listing, cap, l))
+        return false;
+
+    char* p = listing->names + listing->size;
+    p[0] = (char)d_type;
+    memcpy(p + 1, name, l - 1);
+    listing->size += l;
+    ++(listing->count);
+    return true;
+}
+
+#if defined(__linux__)
+
+// the record getdents64() fills the buffer with
+typedef struct dir_scan_dirent64_s
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+}
+dir_scan_dirent64_t;
+
+bool dir_scan_read(int dfd, dir_listing_t* listing)
+{
+    listing->names = 0;
+    listing->size = 0;
+    listing->count = 0;
+    size_t cap = 0;
+
+    char buf[dir_scan_BUFFER_SIZE] __attribute__((aligned(8)));
+    while (true)
+    {
+        long n = syscall(SYS_getdents64, dfd, buf, sizeof(buf));
+        if (n < 0)
+        {
+            dir_listing_term(listing);
+            return false;
+        }
+
+        if (n == 0)
+            break;
+
+        for (long pos = 0; pos < n;)
+        {
+            dir_scan_dirent64_t const* de = (dir_scan_dirent64_t const*)(buf + pos);
+            if (!dir_scan_listing_append(listing, &cap, de->d_type, de->d_name))
+            {
+                dir_listing_term(listing);
+                return false;
+            }
+            pos += de->d_reclen;
+        }
+    }
+
+    atomic_fetch_add(&stats.directories, 1);
+    return true;
+}
+
+// io_uring
+// a minimal ring driven by the raw system calls: the submission queue is filled with
+// statx requests for up to dir_scan_RING_ENTRIES entries, one io_uring_enter() submits
+// them and waits for all of them to complete
+
+typedef struct dir_scan_ring_s
+{
+    int fd;                 // -1 until set up, -2 when io_uring is not available
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring_ptr;
+    size_t sq_ring_size;
+    void* cq_ring_ptr;      // the same as 'sq_ring_ptr' with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    size_t sqes_size;
+    struct statx* results;  // [dir_scan_RING_ENTRIES]
+}
+dir_scan_ring_t;
+
+// one ring per thread, the '**' walker resolves entries on several threads
+static _Thread_local dir_scan_ring_t dir_scan_ring = { .fd = -1 };
+
+// IORING_OP_STATX came in Linux 5.6 with IORING_REGISTER_PROBE, an older kernel sets up
+// a ring that fails every statx request
+static bool dir_scan_ring_has_statx(int fd)
+{
+    size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, size);
+    if (!probe)
+        return false;
+
+    bool result = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0
+        && probe->last_op >= IORING_OP_STATX
+        && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+
+    free(probe);
+    return result;
+}
+
+static bool dir_scan_ring_setup(dir_scan_ring_t* r)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = (int)syscall(__NR_io_uring_setup, dir_scan_RING_ENTRIES, &p);
+    if (fd < 0)
+        return false;
+
+    if (!dir_scan_ring_has_statx(fd))
+    {
+        close(fd);
+        return false;
+    }
+
+    r->fd = fd;
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (r->cq_ring_size > r->sq_ring_size)
+            r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+
+    r->sq_ring_ptr = mmap(0, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    r->cq_ring_ptr = MAP_FAILED;
+    r->sqes = MAP_FAILED;
+    r->results = malloc(dir_scan_RING_ENTRIES * sizeof(struct statx));
+
+    if (r->sq_ring_ptr != MAP_FAILED)
+    {
+        r->cq_ring_ptr = (p.features & IORING_FEAT_SINGLE_MMAP)
+            ? r->sq_ring_ptr
+            : mmap(0, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+        r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        r->sqes = mmap(0, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    }
+
+    if (r->sq_ring_ptr == MAP_FAILED || r->cq_ring_ptr == MAP_FAILED || r->sqes == MAP_FAILED || !r->results)
+    {
+        dir_scan_thread_term();
+        return false;
+    }
+
+    char* sq = r->sq_ring_ptr;
+    r->sq_head = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+
+    char* cq = r->cq_ring_ptr;
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+}
+
+static dir_scan_ring_t* dir_scan_ring_get(void)
+{
+    dir_scan_ring_t* r = &dir_scan_ring;
+    if (r->fd == -1 && !dir_scan_ring_setup(r))
+        r->fd = -2;
+
+    return (r->fd >= 0) ? r : 0;
+}
+
+void dir_scan_thread_term(void)
+{
+    dir_scan_ring_t* r = &dir_scan_ring;
+    if (r->fd < 0)
+        return;
+
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring_ptr && r->cq_ring_ptr != MAP_FAILED && r->cq_ring_ptr != r->sq_ring_ptr)
+        munmap(r->cq_ring_ptr, r->cq_ring_size);
+    if (r->sq_ring_ptr && r->sq_ring_ptr != MAP_FAILED)
+        munmap(r->sq_ring_ptr, r->sq_ring_size);
+
+    free(r->results);
+    close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+// the thread stops using a ring with requests that may still be in flight; the kernel can
+// write their results at any time, so the ring and 'results' are left to them
+static void dir_scan_ring_abandon(dir_scan_ring_t* r)
+{
+    memset(r, 0, sizeof(*r));
+    r->fd = -2;
+}
+
+// submits statx requests for 'entries' (at most dir_scan_RING_ENTRIES) and waits for
+// them, returns false when the ring failed and the entries are to be resolved again;
+// the indices of the requests that failed are stored in 'failed' to be retried
+// synchronously, e.g. for an entry the file system would not examine this way
+static bool dir_scan_ring_statx(dir_scan_ring_t* r, int dfd, char* const* entries, int count, int* failed, int* failed_count)
+{
+    *failed_count = 0;
+
+    unsigned const sq_head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *r->sq_tail;
+    for (int i = 0; i < count; ++i)
+    {
+        unsigned index = tail & r->sq_mask;
+        struct io_uring_sqe* sqe = &r->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dfd;
+        sqe->addr = (uint64_t)(uintptr_t)(entries[i] + 1);
+        sqe->len = STATX_TYPE;
+        sqe->off = (uint64_t)(uintptr_t)&r->results[i];
+        sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+        sqe->user_data = i;
+        r->sq_array[index] = index;
+        ++tail;
+    }
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+    // a signal can interrupt the call before it submitted anything
+    long res;
+    do
+        res = syscall(__NR_io_uring_enter, r->fd, count, count, IORING_ENTER_GETEVENTS, 0, 0);
+    while (res < 0 && errno == EINTR);
+
+    // the requests the kernel took from the queue write to 'results' until they complete,
+    // whatever the call returned
+    int const submitted = (int)(__atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) - sq_head);
+    int completed = 0;
+    while (completed < submitted)
+    {
+        unsigned head = *r->cq_head;
+        unsigned cq_tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == cq_tail)
+        {
+            if (syscall(__NR_io_uring_enter, r->fd, 0, submitted - completed, IORING_ENTER_GETEVENTS, 0, 0) < 0 && errno != EINTR)
+                break;
+            continue;
+        }
+
+        for (; head != cq_tail; ++head, ++completed)
+        {
+            struct io_uring_cqe const* cqe = &r->cqes[head & r->cq_mask];
+            int i = (int)cqe->user_data;
+            if (cqe->res == 0 && (r->results[i].stx_mask & STATX_TYPE))
+                entries[i][0] = (char)IFTODT(r->results[i].stx_mode);
+            else
+                failed[(*failed_count)++] = i;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (completed != submitted)
+    {
+        dir_scan_ring_abandon(r);
+        return false;
+    }
+
+    if (submitted != count)
+    {
+        // the queue is in an unknown state, the thread stops using io_uring
+        dir_scan_thread_term();
+        r->fd = -2;
+        return false;
+    }
+
+    return true;
+}
+
+#else // no getdents64, no io_uring
+
+bool dir_scan_read(int dfd, dir_listing_t* listing)
+{
+    listing->names = 0;
+    listing->size = 0;
+    listing->count = 0;
+    size_t cap = 0;
+
+    int fd = dup(dfd);
+    DIR* dp = (fd == -1) ? 0 : fdopendir(fd);
+    if (!dp)
+    {
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+
+    struct dirent* de;
+    while ((de = readdir(dp)))
+    {
+        if (!dir_scan_listing_append(listing, &cap, de->d_type, de->d_name))
+        {
+            closedir(dp);
+            dir_listing_term(listing);
+            return false;
+        }
+    }
+
+    closedir(dp);
+    atomic_fetch_add(&stats.directories, 1);
+    return true;
+}
+
+void dir_scan_thread_term(void)
+{
+}
+
+#endif
+
+void dir_listing_term(dir_listing_t* listing)
+{
+    free(listing->names);
+    listing->names = 0;
+    listing->size = 0;
+    listing->count = 0;
+}
+
+static void dir_scan_resolve_type(int dfd, char* entry)
+{
+    struct stat stat_struct;
+    if (fstatat(dfd, entry + 1, &stat_struct, AT_SYMLINK_NOFOLLOW) == 0)
+        entry[0] = (char)IFTODT(stat_struct.st_mode);
+}
+
+void dir_scan_resolve_types(int dfd, char* const* entries, int count)
+{
+    int i = 0;
+
+#if defined(__linux__)
+    dir_scan_ring_t* r = (count >= dir_scan_RING_MIN) ? dir_scan_ring_get() : 0;
+    while (r && i < count)
+    {
+        int n = count - i;
+        if (n > dir_scan_RING_ENTRIES)
+            n = dir_scan_RING_ENTRIES;
+
+        int failed[dir_scan_RING_ENTRIES];
+        int failed_count;
+        if (!dir_scan_ring_statx(r, dfd, entries + i, n, failed, &failed_count))
+            break;
+
+        for (int j = 0; j < failed_count; ++j)
+            dir_scan_resolve_type(dfd, entries[i + failed[j]]);
+
+        atomic_fetch_add(&stats.unknown_resolved_ring, n - failed_count);
+        atomic_fetch_add(&stats.unknown_retried, failed_count);
+        i += n;
+    }
+#endif
+
+    atomic_fetch_add(&stats.unknown_resolved_sync, count - i);
+    for (; i < count; ++i)
+        dir_scan_resolve_type(dfd, entries[i]);
+}
+
+void dir_scan_stats_print(void)
+{
+    fprintf(stderr, "dir scan      : %ld directories, %ld unknown types resolved (%ld io_uring, %ld sync, %ld retried)\n",
+        atomic_load(&stats.directories),
+        atomic_load(&stats.unknown_resolved_ring) + atomic_load(&stats.unknown_resolved_sync) + atomic_load(&stats.unknown_retried),
+        atomic_load(&stats.unknown_resolved_ring),
+        atomic_load(&stats.unknown_resolved_sync),
+        atomic_load(&stats.unknown_retried));
+}
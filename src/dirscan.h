@@ -0,0 +1,39 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// directory enumeration for the glob expansion
+// a directory is read in large getdents64() batches into a listing; the entries whose
+// type the file system does not report (DT_UNKNOWN, as on NFS or some overlay mounts)
+// are resolved with statx(), submitted through io_uring so that many requests are in
+// flight at once, or with one fstatat() per entry where io_uring is not available
+// io_uring has no getdents operation, the listing itself is read synchronously
+
+typedef struct dir_listing_s
+{
+    char* names;    // per entry: the d_type byte followed by the 0 terminated name
+    size_t size;    // bytes used in 'names'
+    int count;      // number of entries
+}
+dir_listing_t;
+
+#define dir_listing_NEXT(p) ((p) + strlen((p) + 1) + 2)
+
+bool dir_scan_read(int dfd, dir_listing_t* listing);
+void dir_listing_term(dir_listing_t* listing);
+
+// replaces DT_UNKNOWN in the listing entries 'entries' (pointers to their type byte)
+// of the directory 'dfd' with the type of the entry itself, links are not followed;
+// an entry that cannot be examined stays DT_UNKNOWN
+void dir_scan_resolve_types(int dfd, char* const* entries, int count);
+
+// releases the io_uring instance of the calling thread
+void dir_scan_thread_term(void);
+
+void dir_scan_stats_print(void);
@@ -1,41 +1,366 @@
 // Copyright (c) 2023 Egor Kosmachev
 // Licensed under the MIT license.
 
-#include "glob.h"
-#include "base/dstr.h"
-
 #if defined(__unix__) || defined(__CYGWIN__)
-	// enable telldir(), seekdir() and DT_DIR when using glibc
+	// enable openat() and DT_DIR when using glibc
 	#define _DEFAULT_SOURCE
+	#define _ATFILE_SOURCE
 #endif
 
+#include "glob.h"
+#include "globmatch.h"
+#include "dircache.h"
+#include "dirscan.h"
+#include "base/dstr.h"
+#include "base/dlst.h"
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #if defined(__unix__) || defined(__CYGWIN__)
 	#include <dirent.h>
+	#include <fcntl.h>
+	#include <errno.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <pthread.h>
 #elif _WIN32
 	#include <io.h>
 #endif
 
-static int glob(char const* pattern, char const* pattern_end, char const* str);
-static bool collect_glob_internal_managed(char const* dname, char const* pattern, plst_t* files);
+typedef struct glob_segment_s
+{
+    glob_matcher_t matcher;   // compiled once per glob_append(), used for every entry
+    bool is_match_all;        // empty segment, as in 'dir/', matches every entry
+    bool is_pattern_subdir;   // the segment names directories, more segments follow
+    bool is_recursive;        // '**', any number of directories
+    bool is_literal;          // no wildcards, the entry is looked up by 'literal' instead of a scan
+    dstr_t literal;
+}
+glob_segment_t;
+
+// a pattern being matched in a directory: the segment the directory entries are
+// matched against and the tag of the pattern its matches get
+typedef struct glob_cursor_s
+{
+    glob_segment_t const* seg;
+    int tag;
+}
+glob_cursor_t;
+
+// set in the threads of a '**' walk: nested '**' segments are walked by the worker
+// that reaches them and the directory cache, which is not shared, is not used
+static _Thread_local bool glob_walk_active = false;
+
+// the tag of the pattern a '**' walk expands, in its threads; its workers keep their
+// matches under tags of their own
+static _Thread_local int glob_walk_tag = -1;
+
+// limits of an expansion and what it has used of them so far; the counters are
+// shared with the threads of a '**' walk
+typedef enum glob_limit_e
+{
+    glob_limit_NONE,
+    glob_limit_ENTRIES,
+    glob_limit_RESULTS,
+    glob_limit_DEPTH,
+    glob_limit_TIME
+}
+glob_limit_t;
+
+typedef struct glob_budget_s
+{
+    atomic_long directories;
+    atomic_long entries;
+    atomic_long results;
+    atomic_int exceeded;      // the first limit reached, glob_limit_t
+    atomic_int exceeded_tag;  // the pattern that reached it, -1 for the patterns of a shared scan
+    long long deadline_ns;    // 0 without a time limit
+    size_t base_len;          // length of the base directory path, depths are counted from it
+}
+glob_budget_t;
+
+typedef struct glob_stats_s
+{
+    long expansions;
+    long directories;
+    long entries;
+    long results;
+    long stopped;             // expansions stopped by a limit
+}
+glob_stats_t;
+
+static glob_limits_t glob_limits;
+static glob_budget_t glob_budget;
+static glob_stats_t glob_stats;
+
+static void glob_budget_reset(void);
+static bool glob_budget_enter(char const* path, int tag);
+static bool glob_budget_charge_entries(long count, int tag);
+static bool glob_budget_charge_result(int tag);
+static void glob_budget_report(char const* const* glob_paths, glob_cursor_t const* cursors, int cursor_count);
+
+static bool glob_compile(char const* pattern, dlst_t* segments);
+static void glob_segment_term(glob_segment_t* seg);
+static bool glob_split(char const* glob_path, dstr_t* dname, char const** pattern);
+static bool collect_glob_internal_managed(char const* dname, glob_result_t* result, glob_cursor_t const* cursors, int cursor_count);
 static char const* get_next_pattern(char const* pattern, char const** pattern_end, bool* is_pattern_subdir);
 
 bool glob_append(char const* glob_path, plst_t* files, plst_len_t* files_added)
 {
-    int chr_idx = strcspn(glob_path, "*"); // "*?"
-    char const* chr_ptr = glob_path + chr_idx;
+    plst_len_t old_len = files->len;
+    bool result = glob_append_multi(&glob_path, 1, files);
 
-    if (!*chr_ptr)
+    if (files_added)
+        *files_added = files->len - old_len;
+
+    return result;
+}
+
+bool glob_append_multi(char const* const* glob_paths, int count, plst_t* files)
+{
+    glob_result_t expansion;
+    glob_result_init(&expansion);
+
+    size_t firsts[count + 1];
+    bool result = glob_expand(glob_paths, count, &expansion)
+        && glob_result_group_by_tag(&expansion, count, firsts);
+
+    for (int i = 0; result && i < count; ++i)
+        result = glob_result_paths_append(&expansion, firsts[i], firsts[i + 1] - firsts[i], &files[i]);
+
+    glob_result_term(&expansion);
+    return result;
+}
+
+bool glob_expand(char const* const* glob_paths, int count, glob_result_t* files)
+{
+    // base directory and compiled segments of every pattern, a pattern without
+    // wildcards keeps empty 'segments'
+    dstr_t dnames[count];
+    dlst_t segments[count];
+    bool is_collected[count];
+    glob_cursor_t cursors[count];
+
+    for (int i = 0; i < count; ++i)
     {
-        *files_added = 0;
-        return true;
+        dstr_init(&dnames[i]);
+        dlst_init(&segments[i], sizeof(glob_segment_t));
+        is_collected[i] = false;
+    }
+
+    glob_budget_reset();
+
+    bool result = true;
+    for (int i = 0; result && i < count; ++i)
+    {
+        char const* pattern = 0;
+        result = glob_split(glob_paths[i], &dnames[i], &pattern)
+            && (!pattern || glob_compile(pattern, &segments[i]));
+    }
+
+    // the patterns of one base directory are collected by a single scan of the tree
+    for (int i = 0; result && i < count; ++i)
+    {
+        if (is_collected[i] || dlst_is_empty(&segments[i]))
+            continue;
+
+        int cursor_count = 0;
+        for (int j = i; j < count; ++j)
+        {
+            if (is_collected[j] || dlst_is_empty(&segments[j]) || strcmp(dnames[i].ptr, dnames[j].ptr) != 0)
+                continue;
+
+            cursors[cursor_count].seg = dlst_at(&segments[j], 0);
+            cursors[cursor_count].tag = j;
+            ++cursor_count;
+            is_collected[j] = true;
+        }
+
+        glob_budget.base_len = dnames[i].len;
+        result = collect_glob_internal_managed(dnames[i].ptr, files, cursors, cursor_count);
+        if (!result)
+            glob_budget_report(glob_paths, cursors, cursor_count);
+    }
+
+    // the matches of a pattern are sorted, as POSIX shells do, so the command lines do
+    // not depend on the order the file system lists the entries in
+    if (result)
+        result = glob_result_sort_by_tag(files, count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        dlst_term(&segments[i], (dlst_item_term_func_t)glob_segment_term);
+        dstr_term(&dnames[i]);
+    }
+
+    ++(glob_stats.expansions);
+    glob_stats.directories += atomic_load(&glob_budget.directories);
+    glob_stats.entries += atomic_load(&glob_budget.entries);
+    glob_stats.results += atomic_load(&glob_budget.results);
+
+    return result;
+}
+
+void glob_limits_set(glob_limits_t const* limits)
+{
+    glob_limits = *limits;
+}
+
+void glob_stats_print(void)
+{
+    fprintf(stderr, "glob          : %ld expansions, %ld directories, %ld entries, %ld matches, %ld stopped by a limit\n",
+        glob_stats.expansions, glob_stats.directories, glob_stats.entries, glob_stats.results, glob_stats.stopped);
+
+    if (!glob_limits.max_entries && !glob_limits.max_results && !glob_limits.max_depth && !glob_limits.timeout_ms)
+        return;
+
+    fprintf(stderr, "glob limits   :");
+    if (glob_limits.max_entries)
+        fprintf(stderr, " %ld entries", glob_limits.max_entries);
+    if (glob_limits.max_results)
+        fprintf(stderr, " %ld matches", glob_limits.max_results);
+    if (glob_limits.max_depth)
+        fprintf(stderr, " %d levels", glob_limits.max_depth);
+    if (glob_limits.timeout_ms)
+        fprintf(stderr, " %ld ms", glob_limits.timeout_ms);
+    fprintf(stderr, "\n");
+}
+
+// budget
+static long long glob_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void glob_budget_reset(void)
+{
+    atomic_store(&glob_budget.directories, 0);
+    atomic_store(&glob_budget.entries, 0);
+    atomic_store(&glob_budget.results, 0);
+    atomic_store(&glob_budget.exceeded, glob_limit_NONE);
+    atomic_store(&glob_budget.exceeded_tag, -1);
+    glob_budget.deadline_ns = glob_limits.timeout_ms ? glob_clock_ns() + glob_limits.timeout_ms * 1000000LL : 0;
+    glob_budget.base_len = 0;
+}
+
+// records the first limit reached and the pattern that reached it, the expansion fails
+// from then on; 'tag' is -1 when the limit was reached for several patterns at once
+static bool glob_budget_exceed(glob_limit_t limit, int tag)
+{
+    int none = glob_limit_NONE;
+    if (atomic_compare_exchange_strong(&glob_budget.exceeded, &none, (int)limit))
+        atomic_store(&glob_budget.exceeded_tag, glob_walk_active ? glob_walk_tag : tag);
+    return false;
+}
+
+static bool glob_budget_is_exceeded(void)
+{
+    return atomic_load_explicit(&glob_budget.exceeded, memory_order_relaxed) != glob_limit_NONE;
+}
+
+// called for every directory the expansion reads or looks up entries in
+static bool glob_budget_enter(char const* path, int tag)
+{
+    if (glob_budget_is_exceeded())
+        return false;
+
+    atomic_fetch_add_explicit(&glob_budget.directories, 1, memory_order_relaxed);
+
+    if (glob_limits.max_depth)
+    {
+        // every level below the base directory adds one '/'
+        int depth = 0;
+        for (char const* p = path + glob_budget.base_len; *p; ++p)
+            depth += *p == '/';
+
+        if (depth > glob_limits.max_depth)
+            return glob_budget_exceed(glob_limit_DEPTH, tag);
     }
 
-    char const* pattern;
-    dstr_t dname;
-    dstr_init(&dname);
+    if (glob_budget.deadline_ns && glob_clock_ns() > glob_budget.deadline_ns)
+        return glob_budget_exceed(glob_limit_TIME, tag);
+
+    return true;
+}
+
+static bool glob_budget_charge_entries(long count, int tag)
+{
+    long entries = atomic_fetch_add_explicit(&glob_budget.entries, count, memory_order_relaxed) + count;
+    if (glob_limits.max_entries && entries > glob_limits.max_entries)
+        return glob_budget_exceed(glob_limit_ENTRIES, tag);
+
+    // reading a large directory takes a while, the deadline is checked again after it
+    if (count > 1 && glob_budget.deadline_ns && glob_clock_ns() > glob_budget.deadline_ns)
+        return glob_budget_exceed(glob_limit_TIME, tag);
+
+    return !glob_budget_is_exceeded();
+}
+
+static bool glob_budget_charge_result(int tag)
+{
+    long results = atomic_fetch_add_explicit(&glob_budget.results, 1, memory_order_relaxed) + 1;
+    if (glob_limits.max_results && results > glob_limits.max_results)
+        return glob_budget_exceed(glob_limit_RESULTS, tag);
+
+    return true;
+}
+
+// prints why the expansion of the patterns of 'cursors' was stopped, if a limit stopped
+// it; the pattern that reached the limit is named, all of them when the scan they share
+// reached it
+static void glob_budget_report(char const* const* glob_paths, glob_cursor_t const* cursors, int cursor_count)
+{
+    glob_limit_t limit = (glob_limit_t)atomic_load(&glob_budget.exceeded);
+    if (limit == glob_limit_NONE)
+        return;
+
+    ++(glob_stats.stopped);
+
+    int tag = atomic_load(&glob_budget.exceeded_tag);
+    fprintf(stderr, "error: expansion of ");
+    if (tag >= 0)
+        fprintf(stderr, "'%s'", glob_paths[tag]);
+    else
+    {
+        for (int i = 0; i < cursor_count; ++i)
+            fprintf(stderr, "%s'%s'", i ? ", " : "", glob_paths[cursors[i].tag]);
+    }
+
+    switch (limit)
+    {
+        case glob_limit_ENTRIES:
+            fprintf(stderr, " stopped: more than %ld directory entries read\n", glob_limits.max_entries);
+            break;
+        case glob_limit_RESULTS:
+            fprintf(stderr, " stopped: more than %ld matches\n", glob_limits.max_results);
+            break;
+        case glob_limit_DEPTH:
+            fprintf(stderr, " stopped: directories more than %d levels deep\n", glob_limits.max_depth);
+            break;
+        case glob_limit_TIME:
+            fprintf(stderr, " stopped: took longer than %ld ms\n", glob_limits.timeout_ms);
+            break;
+        default:
+            fprintf(stderr, " stopped\n");
+            break;
+    }
+}
+
+// splits 'glob_path' into the directory the expansion starts from and the pattern
+// relative to it, 'pattern' is left 0 when there is nothing to expand
+static bool glob_split(char const* glob_path, dstr_t* dname, char const** pattern)
+{
+    int chr_idx = strcspn(glob_path, "*?[");
+    char const* chr_ptr = glob_path + chr_idx;
+
+    if (!*chr_ptr)
+        return true;
 
     // '/usr/ab*c/bcd/2.txt'
     //         ^
@@ -60,12 +385,9 @@ bool glob_append(char const* glob_path, plst_t* files, plst_len_t* files_added)
         //   dname: '/usr'
         // pattern: 'ab*c/bcd/2.txt'
         int l = chr_dir - glob_path;
-        if (!dstr_append_view(&dname, glob_path, l))
-        {
-            dstr_term(&dname);
+        if (!dstr_append_view(dname, glob_path, l))
             return false;
-        }
-        pattern = chr_dir + 1;
+        *pattern = chr_dir + 1;
     }
     else
     {
@@ -73,76 +395,87 @@ bool glob_append(char const* glob_path, plst_t* files, plst_len_t* files_added)
         // ^
         //   dname: ''
         // pattern: 'usr*/abc/bcd/2.txt'
-        if (!dstr_append_chr(&dname, '.'))
-        {
-            dstr_term(&dname);
+        if (!dstr_append_chr(dname, '.'))
             return false;
-        }
-        pattern = glob_path;
+        *pattern = glob_path;
     }
 
-    plst_len_t old_len = files->len;
-    bool result = collect_glob_internal_managed(dname.ptr, pattern, files);
-    plst_len_t new_len = files->len;
-
-    if (files_added)
-        *files_added = new_len - old_len;
-    
-    dstr_term(&dname);
-    return result;
+    return true;
 }
 
-int glob(char const* pattern, char const* pattern_end, char const* str)
+static bool glob_compile(char const* pattern, dlst_t* segments)
 {
-    const char * here;
-
+    glob_segment_t seg;
     while (true)
     {
-        char c = *pattern;
+        char const* pattern_end;
+        bool is_pattern_subdir;
+        char const* next_pattern = get_next_pattern(pattern, &pattern_end, &is_pattern_subdir);
 
-        ++pattern;
-        if (pattern > pattern_end)
-            return *str ? -1 : 0;
+        bool is_recursive = (pattern_end - pattern == 2) && pattern[0] == '*' && pattern[1] == '*';
+        glob_segment_t const* prev = dlst_is_empty(segments) ? 0 : dlst_at(segments, dlst_length(segments) - 1);
 
-        switch (c)
+        // '**/**' is the same as '**'
+        if (!(is_recursive && prev && prev->is_recursive))
         {
-        case '\0':
-            return *str ? -1 : 0;
+            if (!glob_matcher_compile(&seg.matcher, pattern, pattern_end))
+                return false;
 
-        //case '?':
-        //    if (!*str++)
-        //        return 1;
-        //    break;
+            seg.is_match_all = (pattern == pattern_end);
+            seg.is_pattern_subdir = is_pattern_subdir;
+            seg.is_recursive = is_recursive;
 
-        case '*':
-            here = str;
+            seg.is_literal = !seg.is_match_all;
+            for (char const* p = pattern; seg.is_literal && p < pattern_end; ++p)
+                seg.is_literal = !strchr("*?[", *p);
 
-            while (*str)
-                ++str;
+            dstr_init_arena(&seg.literal, segments->arena);
+            if (seg.is_literal && !dstr_append_view(&seg.literal, pattern, pattern_end - pattern))
+                seg.is_literal = false;
 
-            while ( str != here )
+            if (!dlst_append(segments, &seg))
             {
-                int r;
-
-                if (*pattern)
-                    r = glob(pattern, pattern_end, str);
-                else
-                    r = (*str) ? -1 : 0;
-
-                if ( !r )
-                    return 0;
-                if ( r < 0 )
-                    return 1;
-                --str;
+                glob_segment_term(&seg);
+                return false;
             }
-            break;
+        }
 
-        default:
-            if ( *str++ != pattern[-1] )
-                return 1;
+        if (!is_pattern_subdir)
             break;
+
+        pattern = next_pattern;
+    }
+
+    // 'dir/**' stands for all the files under 'dir'
+    glob_segment_t* last = dlst_at(segments, dlst_length(segments) - 1);
+    if (last->is_recursive)
+    {
+        last->is_pattern_subdir = true;
+
+        char const* star = "*";
+        if (!glob_matcher_compile(&seg.matcher, star, star + 1))
+            return false;
+
+        seg.is_match_all = true;
+        seg.is_pattern_subdir = false;
+        seg.is_recursive = false;
+        seg.is_literal = false;
+        dstr_init_arena(&seg.literal, segments->arena);
+
+        if (!dlst_append(segments, &seg))
+        {
+            glob_segment_term(&seg);
+            return false;
         }
     }
+
+    return true;
+}
+
+static void glob_segment_term(glob_segment_t* seg)
+{
+    glob_matcher_term(&seg->matcher);
+    dstr_term(&seg->literal);
 }
 
 char const* get_next_pattern(char const* pattern, char const** pattern_end, bool* is_pattern_subdir)
@@ -188,103 +521,599 @@ char const* get_next_pattern(char const* pattern, char const** pattern_end, bool
     return end;
 }
 
-bool collect_glob_internal(char const* dname, DIR* dp, char const* pattern, plst_t* files, dstr_t* inner_dir_memory_holder, dstr_t* inner_file_memory_holder)
+static void glob_path_truncate(dstr_t* path, dstr_len_t len)
 {
-    char const* pattern_end;
-    bool is_pattern_subdir;
-    char const* next_pattern = get_next_pattern(pattern, &pattern_end, &is_pattern_subdir);
+    path->len = len;
+    path->ptr[len] = 0;
+}
 
-    struct dirent* de;
-    while ((de = readdir(dp)))
+static bool glob_path_append_name(dstr_t* path, char const* name)
+{
+    if (!dstr_append_chr(path, '/'))
+        return false;
+
+    return dstr_append_str(path, name);
+}
+
+static bool collect_glob_internal(int dfd, dstr_t* path, glob_result_t* files, int dir, glob_cursor_t const* cursors, int cursor_count);
+static bool collect_glob_walk(char const* dname, glob_segment_t const* seg, glob_result_t* files, int tag);
+
+// descends into the subdirectory 'name', open as 'sub_dfd', of the directory 'dir' of
+// 'files' with the cursors 'sub_cursors'
+static bool collect_glob_subdir(int sub_dfd, char const* name, dstr_t* path, glob_result_t* files, int dir, glob_cursor_t const* sub_cursors, int sub_cursor_count)
+{
+    dstr_len_t path_len = path->len;
+    if (!glob_path_append_name(path, name))
+    {
+        if (sub_dfd != -1)
+            close(sub_dfd);
+        return false;
+    }
+
+    bool result = true;
+    if (sub_dfd == -1)
+    {
+        perror(path->ptr);
+        result = false;
+    }
+    else
     {
-        if 
-        (
-            is_pattern_subdir == false 
-                && de->d_type == DT_REG 
-                && de->d_name[0] != '.'
-        )
+        int sub_dir = glob_result_dir_push(files, dir, name, strlen(name));
+        if (sub_dir == -1)
         {
-            if ((pattern >= pattern_end) || (glob(pattern, pattern_end, de->d_name) == 0))
-            {
-                if (!dstr_assign_str(inner_file_memory_holder, dname))
-                    return false;
+            close(sub_dfd);
+            result = false;
+        }
+        else
+        {
+            // recursively traverse subdirectory
+            result = collect_glob_internal(sub_dfd, path, files, sub_dir, sub_cursors, sub_cursor_count);
+            glob_result_dir_drop_if_empty(files, sub_dir);
+        }
+    }
 
-                if (!dstr_append_chr(inner_file_memory_holder, '/'))
-                    return false;
+    glob_path_truncate(path, path_len);
+    return result;
+}
+
+// matches the entry 'name' of the directory 'dfd' with path 'path' against the segment of
+// every cursor; the subdirectory is read once for all the cursors that descend into it
+static bool collect_glob_entry(int dfd, char const* name, unsigned char d_type, dstr_t* path, glob_result_t* files, int dir, glob_cursor_t const* cursors, int cursor_count)
+{
+    if (name[0] == '.')
+        return true;
 
-                if (!dstr_append_str(inner_file_memory_holder, de->d_name))
-                    return false;
+    glob_cursor_t sub_cursors[cursor_count];
+    int sub_cursor_count = 0;
 
-                if (!plst_append_copy_from_view(files, inner_file_memory_holder->ptr, inner_file_memory_holder->len))
-                    return false;
+    size_t name_len = 0;
+    bool result = true;
+
+    for (int i = 0; result && i < cursor_count; ++i)
+    {
+        glob_segment_t const* seg = cursors[i].seg;
+
+        if (seg->is_pattern_subdir ? (d_type != DT_DIR) : (d_type != DT_REG))
+            continue;
+
+        if (!seg->is_match_all && !glob_matcher_match(&seg->matcher, name))
+            continue;
+
+        if (seg->is_pattern_subdir)
+        {
+            sub_cursors[sub_cursor_count].seg = seg + 1;
+            sub_cursors[sub_cursor_count].tag = cursors[i].tag;
+            ++sub_cursor_count;
+            continue;
+        }
+
+        if (!name_len)
+            name_len = strlen(name);
+
+        result = glob_budget_charge_result(cursors[i].tag)
+            && glob_result_file_push(files, dir, cursors[i].tag, name, name_len);
+    }
+
+    if (result && sub_cursor_count)
+    {
+        // the parent stays open, the subdirectory is opened relative to it
+        int sub_dfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        result = collect_glob_subdir(sub_dfd, name, path, files, dir, sub_cursors, sub_cursor_count);
+    }
+
+    return result;
+}
+
+// a file system may not report the entry types (DT_UNKNOWN), then the entries the
+// cursors could take are examined, all of them in one batch; without cursors every
+// entry is, as the '**' walker descends into all directories
+static bool glob_resolve_unknown(int dfd, dir_listing_t* listing, glob_cursor_t const* cursors, int cursor_count)
+{
+    char** entries = 0;
+    int count = 0;
+    int cap = 0;
+
+    char* end = listing->names + listing->size;
+    for (char* p = listing->names; p < end; p = dir_listing_NEXT(p))
+    {
+        if ((unsigned char)p[0] != DT_UNKNOWN || p[1] == '.')
+            continue;
+
+        bool is_candidate = !cursors;
+        for (int i = 0; !is_candidate && i < cursor_count; ++i)
+        {
+            glob_segment_t const* seg = cursors[i].seg;
+            is_candidate = seg->is_match_all || glob_matcher_match(&seg->matcher, p + 1);
+        }
+
+        if (!is_candidate)
+            continue;
+
+        if (count == cap)
+        {
+            int new_cap = cap ? cap * 2 : 64;
+            char** new_entries = realloc(entries, new_cap * sizeof(char*));
+            if (!new_entries)
+            {
+                free(entries);
+                fprintf(stderr, "No enough memory.\n");
+                return false;
             }
+            entries = new_entries;
+            cap = new_cap;
+        }
+
+        entries[count++] = p;
+    }
+
+    if (count)
+        dir_scan_resolve_types(dfd, entries, count);
+
+    free(entries);
+    return true;
+}
+
+// a segment without wildcards names at most one entry, which is looked up directly
+// instead of reading the whole directory
+static bool collect_glob_literal(int dfd, dstr_t* path, glob_result_t* files, int dir, glob_cursor_t const* cursor)
+{
+    glob_segment_t const* seg = cursor->seg;
+    char const* name = seg->literal.ptr;
+
+    if (!glob_budget_charge_entries(1, cursor->tag))
+        return false;
+
+    int sub_dfd = -1;
+    if (seg->is_pattern_subdir)
+    {
+        // a symbolic link is not followed, as a scan only descends into DT_DIR entries
+        sub_dfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (sub_dfd == -1)
+        {
+            if (errno == ENOENT || errno == ENOTDIR || errno == ELOOP)
+                return true;
+        }
+    }
+    else
+    {
+        struct stat stat_struct;
+        if (fstatat(dfd, name, &stat_struct, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(stat_struct.st_mode))
+            return true;
+    }
+
+    if (!seg->is_pattern_subdir)
+    {
+        return glob_budget_charge_result(cursor->tag)
+            && glob_result_file_push(files, dir, cursor->tag, name, seg->literal.len);
+    }
+
+    glob_cursor_t sub_cursor = { seg + 1, cursor->tag };
+    return collect_glob_subdir(sub_dfd, name, path, files, dir, &sub_cursor, 1);
+}
+
+// 'dfd' is owned by the function, 'path' is the path of the directory and is
+// extended in place with the names of its entries
+static bool collect_glob_internal(int dfd, dstr_t* path, glob_result_t* files, int dir, glob_cursor_t const* cursors, int cursor_count)
+{
+    // a '**' segment is walked on its own, a literal one is looked up, the other
+    // cursors share the scan
+    glob_cursor_t scan_cursors[cursor_count];
+    int scan_cursor_count = 0;
+
+    bool result = glob_budget_enter(path->ptr, cursor_count == 1 ? cursors[0].tag : -1);
+    for (int i = 0; result && i < cursor_count; ++i)
+    {
+        if (cursors[i].seg->is_recursive)
+            result = collect_glob_walk(path->ptr, cursors[i].seg + 1, files, cursors[i].tag);
+        else if (cursors[i].seg->is_literal)
+            result = collect_glob_literal(dfd, path, files, dir, &cursors[i]);
+        else
+            scan_cursors[scan_cursor_count++] = cursors[i];
+    }
+
+    if (!result || !scan_cursor_count)
+    {
+        close(dfd);
+        return result;
+    }
+
+    // a listing from the cache or one of its own
+    dir_listing_t own_listing;
+    dir_listing_t* listing = (dir_cache_is_enabled() && !glob_walk_active) ? dir_cache_acquire(dfd) : 0;
+    bool is_cached = listing != 0;
+    if (!listing)
+    {
+        if (!dir_scan_read(dfd, &own_listing))
+        {
+            perror(path->ptr);
+            close(dfd);
+            return false;
+        }
+        listing = &own_listing;
+    }
+
+    result = glob_budget_charge_entries(listing->count, scan_cursor_count == 1 ? scan_cursors[0].tag : -1)
+        && glob_resolve_unknown(dfd, listing, scan_cursors, scan_cursor_count);
+
+    char const* end = listing->names + listing->size;
+    for (char const* p = listing->names; result && p < end; p = dir_listing_NEXT(p))
+        result = collect_glob_entry(dfd, p + 1, (unsigned char)p[0], path, files, dir, scan_cursors, scan_cursor_count);
+
+    if (is_cached)
+        dir_cache_release(listing);
+    else
+        dir_listing_term(listing);
+
+    close(dfd);
+    return result;
+}
+
+// '**' walker
+// the tree under a directory is walked by a small pool of threads, each with a deque
+// of directories still to visit: a worker takes its own work from the bottom of its
+// deque (depth first) and steals from the top of the others (the largest subtrees)
+// every visited directory is matched against the rest of the pattern; each worker
+// keeps its matches in a result of its own, under the whole paths of the visited
+// directories; the results are merged and sorted with the rest of the expansion, so
+// the order does not depend on the scheduling
+
+#define glob_walk_WORKERS_MAX 8
+
+typedef struct glob_walk_deque_s
+{
+    pthread_mutex_t lock;
+    char** items;      // paths of the directories to visit
+    int cap;
+    int top;           // thieves take from here
+    int bottom;        // the owner pushes and pops here
+}
+glob_walk_deque_t;
+
+typedef struct glob_walk_s
+{
+    glob_segment_t const* seg;    // applied to every directory of the tree
+    int tag;                      // of the pattern, for the report of a limit
+    int worker_count;
+    glob_walk_deque_t deques[glob_walk_WORKERS_MAX];
+    glob_result_t files[glob_walk_WORKERS_MAX];
+    atomic_int pending;    // directories pushed but not visited yet
+    atomic_bool failed;
+
+    // a worker without a directory to visit waits for a push or for the end of the walk
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    atomic_int idle;       // workers waiting
+    atomic_uint pushes;    // changes when a directory is pushed
+}
+glob_walk_t;
+
+typedef struct glob_walk_worker_s
+{
+    glob_walk_t* walk;
+    int id;
+}
+glob_walk_worker_t;
+
+// wakes the waiting workers, all of them at the end of the walk
+static void glob_walk_wake(glob_walk_t* w, bool all)
+{
+    pthread_mutex_lock(&w->idle_lock);
+    if (all)
+        pthread_cond_broadcast(&w->idle_cond);
+    else
+        pthread_cond_signal(&w->idle_cond);
+    pthread_mutex_unlock(&w->idle_lock);
+}
+
+static bool glob_walk_push(glob_walk_t* w, int id, char* dname)
+{
+    glob_walk_deque_t* d = &w->deques[id];
+    pthread_mutex_lock(&d->lock);
+
+    if (d->bottom == d->cap)
+    {
+        if (d->top > 0)
+        {
+            memmove(d->items, d->items + d->top, (d->bottom - d->top) * sizeof(char*));
+            d->bottom -= d->top;
+            d->top = 0;
         }
-        else if 
-        (
-            is_pattern_subdir == true 
-                && de->d_type == DT_DIR 
-                && de->d_name[0] != '.'
-        ) 
+        else
         {
-            if ((pattern >= pattern_end) || (glob(pattern, pattern_end, de->d_name) == 0))
+            int cap = d->cap ? d->cap * 2 : 64;
+            char** items = realloc(d->items, cap * sizeof(char*));
+            if (!items)
             {
-                // form new path
-                if (!dstr_assign_str(inner_dir_memory_holder, dname))
-                    return false;
-
-                if (!dstr_append_chr(inner_dir_memory_holder, '/'))
-                    return false;
-
-                if (!dstr_append_str(inner_dir_memory_holder, de->d_name))
-                    return false;
-
-                // save location in directory
-                long offset = telldir(dp);
-                if (offset == -1)
-                {
-                    perror(dname);
-                    return false;
-                }
-                closedir(dp);
-
-                // recursively traverse subdirectory
-                if (!collect_glob_internal_managed(inner_dir_memory_holder->ptr, next_pattern, files))
-                    return false;
-
-                // restore position in directory
-                dp = opendir(dname);
-                if (!dp)
-                {
-                    perror(dname);
-                    return false; 
-                }
-                seekdir(dp, offset);
+                pthread_mutex_unlock(&d->lock);
+                fprintf(stderr, "No enough memory.\n");
+                return false;
             }
+            d->items = items;
+            d->cap = cap;
         }
     }
 
+    atomic_fetch_add(&w->pending, 1);
+    d->items[d->bottom++] = dname;
+
+    pthread_mutex_unlock(&d->lock);
+
+    // a worker counts itself idle before it checks 'pushes', so one of the two sees
+    // the change of the other
+    atomic_fetch_add(&w->pushes, 1);
+    if (atomic_load(&w->idle))
+        glob_walk_wake(w, false);
+
     return true;
 }
 
-static bool collect_glob_internal_managed(char const* dname, char const* pattern, plst_t* files)
+static char* glob_walk_pop(glob_walk_deque_t* d, bool steal)
+{
+    char* dname = 0;
+    pthread_mutex_lock(&d->lock);
+
+    if (d->bottom > d->top)
+        dname = steal ? d->items[d->top++] : d->items[--d->bottom];
+
+    if (d->bottom == d->top)
+        d->bottom = d->top = 0;
+
+    pthread_mutex_unlock(&d->lock);
+    return dname;
+}
+
+// a directory of the tree that cannot be read, e.g. without permission, is reported and
+// left out of the walk
+static bool glob_walk_visit(glob_walk_t* w, int id, char const* dname)
+{
+    if (!glob_budget_enter(dname, w->tag))
+        return false;
+
+    int dfd = open(dname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd == -1)
+    {
+        perror(dname);
+        return errno != ENOMEM;
+    }
+
+    dir_listing_t listing;
+    if (!dir_scan_read(dfd, &listing))
+    {
+        int err = errno;
+        perror(dname);
+        close(dfd);
+        return err != ENOMEM;
+    }
+
+    dstr_t path;
+    dstr_init(&path);
+    glob_result_t* files = &w->files[id];
+    int dir = -1;
+    bool result = glob_budget_charge_entries(listing.count, w->tag)
+        && dstr_assign_str(&path, dname)
+        && (dir = glob_result_dir_push(files, -1, path.ptr, path.len)) != -1
+        && glob_resolve_unknown(dfd, &listing, 0, 0);
+
+    char const* end = listing.names + listing.size;
+    for (char const* p = listing.names; result && !atomic_load(&w->failed) && p < end; p = dir_listing_NEXT(p))
+    {
+        char const* name = p + 1;
+        unsigned char d_type = (unsigned char)p[0];
+
+        if (d_type == DT_DIR && name[0] != '.')
+        {
+            dstr_len_t path_len = path.len;
+            result = glob_path_append_name(&path, name);
+
+            char* sub_dname = result ? malloc(path.len + 1) : 0;
+            if (sub_dname)
+            {
+                memcpy(sub_dname, path.ptr, path.len + 1);
+                result = glob_walk_push(w, id, sub_dname);
+                if (!result)
+                    free(sub_dname);
+            }
+            else if (result)
+            {
+                fprintf(stderr, "No enough memory.\n");
+                result = false;
+            }
+
+            glob_path_truncate(&path, path_len);
+        }
+
+        if (result)
+        {
+            glob_cursor_t cursor = { w->seg, 0 };
+            result = collect_glob_entry(dfd, name, d_type, &path, files, dir, &cursor, 1);
+        }
+    }
+
+    glob_result_dir_drop_if_empty(files, dir);
+    dstr_term(&path);
+    dir_listing_term(&listing);
+    close(dfd);
+    return result;
+}
+
+static void glob_walk_run(glob_walk_t* w, int id)
+{
+    while (!atomic_load(&w->failed))
+    {
+        unsigned pushes = atomic_load(&w->pushes);
+        char* dname = glob_walk_pop(&w->deques[id], false);
+        for (int i = 1; !dname && i < w->worker_count; ++i)
+            dname = glob_walk_pop(&w->deques[(id + i) % w->worker_count], true);
+
+        if (!dname)
+        {
+            // the directories being visited can still push more
+            pthread_mutex_lock(&w->idle_lock);
+            atomic_fetch_add(&w->idle, 1);
+            while (atomic_load(&w->pushes) == pushes && atomic_load(&w->pending) != 0 && !atomic_load(&w->failed))
+                pthread_cond_wait(&w->idle_cond, &w->idle_lock);
+            atomic_fetch_sub(&w->idle, 1);
+            pthread_mutex_unlock(&w->idle_lock);
+
+            if (atomic_load(&w->pending) == 0)
+                break;
+            continue;
+        }
+
+        bool is_visited = glob_walk_visit(w, id, dname);
+        free(dname);
+        if (!is_visited)
+        {
+            atomic_store(&w->failed, true);
+            glob_walk_wake(w, true);
+        }
+
+        if (atomic_fetch_sub(&w->pending, 1) == 1)
+            glob_walk_wake(w, true);
+    }
+}
+
+static void* glob_walk_thread(void* arg)
 {
-    DIR* dp = opendir(dname);
-    if (!dp) 
+    glob_walk_worker_t* worker = arg;
+    glob_walk_active = true;
+    glob_walk_tag = worker->walk->tag;
+    glob_walk_run(worker->walk, worker->id);
+    dir_scan_thread_term();
+    return 0;
+}
+
+static bool collect_glob_walk(char const* dname, glob_segment_t const* seg, glob_result_t* files, int tag)
+{
+    glob_walk_t w;
+    w.seg = seg;
+    w.tag = glob_walk_active ? glob_walk_tag : tag;
+    atomic_init(&w.pending, 0);
+    atomic_init(&w.failed, false);
+    atomic_init(&w.idle, 0);
+    atomic_init(&w.pushes, 0);
+    pthread_mutex_init(&w.idle_lock, 0);
+    pthread_cond_init(&w.idle_cond, 0);
+
+    w.worker_count = 1;
+    if (!glob_walk_active)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        w.worker_count = (cpus < 1) ? 1 : (cpus > glob_walk_WORKERS_MAX) ? glob_walk_WORKERS_MAX : (int)cpus;
+    }
+
+    for (int i = 0; i < w.worker_count; ++i)
+    {
+        glob_walk_deque_t* d = &w.deques[i];
+        pthread_mutex_init(&d->lock, 0);
+        d->items = 0;
+        d->cap = d->top = d->bottom = 0;
+        glob_result_init(&w.files[i]);
+    }
+
+    size_t l = strlen(dname) + 1;
+    char* root = malloc(l);
+    bool result = root != 0;
+    if (root)
+    {
+        memcpy(root, dname, l);
+        result = glob_walk_push(&w, 0, root);
+        if (!result)
+            free(root);
+    }
+
+    if (result)
+    {
+        // the calling thread is worker 0
+        pthread_t threads[glob_walk_WORKERS_MAX];
+        glob_walk_worker_t workers[glob_walk_WORKERS_MAX];
+        int started = 1;
+        for (; started < w.worker_count; ++started)
+        {
+            workers[started].walk = &w;
+            workers[started].id = started;
+            if (pthread_create(&threads[started], 0, glob_walk_thread, &workers[started]) != 0)
+                break;
+        }
+
+        bool was_active = glob_walk_active;
+        int was_tag = glob_walk_tag;
+        glob_walk_active = true;
+        glob_walk_tag = w.tag;
+        glob_walk_run(&w, 0);
+        glob_walk_active = was_active;
+        glob_walk_tag = was_tag;
+
+        for (int i = 1; i < started; ++i)
+            pthread_join(threads[i], 0);
+
+        result = !atomic_load(&w.failed);
+    }
+
+    // the expansion is sorted at the end, the order the workers found the matches
+    // in does not matter
+    for (int i = 0; result && i < w.worker_count; ++i)
+        result = glob_result_merge(files, &w.files[i], 0, 0, tag);
+
+    for (int i = 0; i < w.worker_count; ++i)
+    {
+        glob_walk_deque_t* d = &w.deques[i];
+        for (int j = d->top; j < d->bottom; ++j)
+            free(d->items[j]);
+        free(d->items);
+        pthread_mutex_destroy(&d->lock);
+        glob_result_term(&w.files[i]);
+    }
+
+    pthread_cond_destroy(&w.idle_cond);
+    pthread_mutex_destroy(&w.idle_lock);
+    return result;
+}
+
+static bool collect_glob_internal_managed(char const* dname, glob_result_t* files, glob_cursor_t const* cursors, int cursor_count)
+{
+    int dfd = open(dname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd == -1) 
     {
         perror(dname);
         return false;
     }
 
-    dstr_t dstr_dir, dstr_file;
-    dstr_init(&dstr_dir);
-    dstr_init(&dstr_file);
+    // one buffer for the paths of all levels
+    dstr_t path;
+    dstr_init(&path);
 
-    bool result = collect_glob_internal(dname, dp, pattern, files, &dstr_dir, &dstr_file);
+    int dir = -1;
+    if (!dstr_assign_str(&path, dname) || (dir = glob_result_dir_push(files, -1, path.ptr, path.len)) == -1)
+    {
+        close(dfd);
+        dstr_term(&path);
+        return false;
+    }
 
-    dstr_term(&dstr_dir);
-    dstr_term(&dstr_file);
-    
-    closedir(dp);
-    
+    bool result = collect_glob_internal(dfd, &path, files, dir, cursors, cursor_count);
+    glob_result_dir_drop_if_empty(files, dir);
+
+    dstr_term(&path);
     return result;
 }
@@ -5,6 +5,34 @@
 
 #include "base/bool.h"
 #include "base/plst.h"
+#include "globresult.h"
 
+// appends the regular files matching 'glob_path' to 'files', sorted by their paths
+// '*' matches within one path segment, a '**' segment matches any number of directories
 bool glob_append(char const* glob_path, plst_t* files, plst_len_t* files_added);
 
+// expands 'count' patterns at once, appending the matches of 'glob_paths[i]' to 'files[i]'
+// in the order glob_append() would; patterns with the same base directory are matched
+// in a single scan, so every directory is read once however many patterns visit it
+bool glob_append_multi(char const* const* glob_paths, int count, plst_t* files);
+
+// as glob_append_multi(), the matches of 'glob_paths[i]' are added to 'files' tagged 'i'
+// without building their paths; the files are grouped by tag and sorted within a tag
+bool glob_expand(char const* const* glob_paths, int count, glob_result_t* files);
+
+
+// limits of one expansion (a glob_append() or glob_append_multi() call), 0 is no limit;
+// reaching one stops the expansion with an error message and a failure
+typedef struct glob_limits_s
+{
+    long max_entries;   // directory entries read
+    long max_results;   // matches of all the patterns
+    int max_depth;      // directory levels below the base directory of a pattern
+    long timeout_ms;    // wall-clock time
+}
+glob_limits_t;
+
+// sets the limits of the expansions that follow, for the rest of the session
+void glob_limits_set(glob_limits_t const* limits);
+
+void glob_stats_print(void);
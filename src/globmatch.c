@@ -0,0 +1,481 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "globmatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define GLOB_MATCHER_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 code is compiled for the function only and used when the cpu has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GLOB_MATCHER_AVX2
+#include <immintrin.h>
+#endif
+
+// parses '[...]' starting at 'p' into 'set', returns the character after ']'
+// or 0 when the class is not terminated (the '[' is then an ordinary character)
+static char const* glob_matcher_parse_class(char const* p, char const* end, bool set[256])
+{
+    char const* cur = p + 1;
+    bool negate = false;
+    if (cur < end && (*cur == '!' || *cur == '^'))
+    {
+        negate = true;
+        ++cur;
+    }
+
+    memset(set, 0, 256 * sizeof(bool));
+
+    // a ']' right after '[' or '[!' is part of the class
+    char const* first = cur;
+    while (cur < end && (*cur != ']' || cur == first))
+    {
+        unsigned char lo = (unsigned char)cur[0];
+        if (cur + 2 < end && cur[1] == '-' && cur[2] != ']')
+        {
+            unsigned char hi = (unsigned char)cur[2];
+            for (unsigned c = lo; c <= hi; ++c)
+                set[c] = true;
+            cur += 3;
+        }
+        else
+        {
+            set[lo] = true;
+            ++cur;
+        }
+    }
+
+    if (cur >= end)
+        return 0;
+
+    if (negate)
+    {
+        for (int c = 0; c < 256; ++c)
+            set[c] = !set[c];
+    }
+
+    // a name never holds these
+    set[0] = false;
+    set['/'] = false;
+
+    return cur + 1;
+}
+
+static int glob_matcher_count_tokens(char const* pattern, char const* pattern_end)
+{
+    bool set[256];
+    int count = 0;
+    char const* p = pattern;
+    while (p < pattern_end)
+    {
+        if (*p == '*')
+        {
+            while (p < pattern_end && *p == '*')
+                ++p;
+        }
+        else if (*p == '[')
+        {
+            char const* next = glob_matcher_parse_class(p, pattern_end, set);
+            p = next ? next : p + 1;
+        }
+        else
+        {
+            ++p;
+        }
+
+        ++count;
+    }
+
+    return count;
+}
+
+static inline void glob_matcher_set_bit(uint64_t* words, int bit)
+{
+    words[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+static void glob_matcher_anchor_assign(glob_matcher_anchor_t* a, char const* str, int len, bool is_right_aligned)
+{
+    // a longer literal is cut to the characters next to the wildcard free end
+    if (len > glob_matcher_ANCHOR_MAX)
+    {
+        if (is_right_aligned)
+            str += len - glob_matcher_ANCHOR_MAX;
+        len = glob_matcher_ANCHOR_MAX;
+    }
+
+    memset(a->chars, 0, sizeof(a->chars));
+    memcpy(is_right_aligned ? a->chars + sizeof(a->chars) - len : a->chars, str, len);
+    a->len = len;
+}
+
+// finds the literal runs of the pattern: the one it starts with, the one it ends
+// with and the longest one in between; every matching name holds all three
+static void glob_matcher_compile_anchors(glob_matcher_t* this_p, char const* pattern, char const* pattern_end)
+{
+    bool set[256];
+    char const* run = pattern;        // start of the current literal run
+    char const* prefix_end = pattern_end;
+    char const* infix = pattern;
+    int infix_len = 0;
+    int wild_count = 0;
+    int star_count = 0;
+
+    char const* p = pattern;
+    while (p < pattern_end)
+    {
+        char const* next = 0;
+        if (*p == '*')
+        {
+            next = p;
+            while (next < pattern_end && *next == '*')
+                ++next;
+            ++star_count;
+        }
+        else if (*p == '?')
+        {
+            next = p + 1;
+        }
+        else if (*p == '[')
+        {
+            next = glob_matcher_parse_class(p, pattern_end, set);
+        }
+
+        if (!next)
+        {
+            ++p;
+            continue;
+        }
+
+        if (!wild_count)
+            prefix_end = p;
+        else if (p - run > infix_len)
+        {
+            infix = run;
+            infix_len = p - run;
+        }
+
+        ++wild_count;
+        p = next;
+        run = p;
+    }
+
+    this_p->min_len = this_p->token_count - star_count;
+
+    glob_matcher_anchor_assign(&this_p->prefix, pattern, prefix_end - pattern, false);
+    glob_matcher_anchor_assign(&this_p->suffix, run, wild_count ? pattern_end - run : 0, true);
+    glob_matcher_anchor_assign(&this_p->infix, infix, infix_len, false);
+
+    this_p->is_anchored_exact = wild_count == 1 && star_count == 1
+        && prefix_end - pattern <= glob_matcher_ANCHOR_MAX
+        && pattern_end - run <= glob_matcher_ANCHOR_MAX;
+
+#if defined(GLOB_MATCHER_AVX2)
+    this_p->is_avx2 = __builtin_cpu_supports("avx2");
+#else
+    this_p->is_avx2 = false;
+#endif
+}
+
+bool glob_matcher_compile(glob_matcher_t* this_p, char const* pattern, char const* pattern_end)
+{
+    int token_count = glob_matcher_count_tokens(pattern, pattern_end);
+    int word_count = (token_count + 1 + 63) / 64;
+
+    this_p->token_count = token_count;
+    this_p->word_count = word_count;
+    this_p->accept = 0;
+    this_p->star = 0;
+
+    uint64_t* accept = this_p->accept_inline;
+    uint64_t* star = this_p->star_inline;
+    if (word_count > glob_matcher_WORDS_INLINE)
+    {
+        this_p->accept = calloc(256 * word_count, sizeof(uint64_t));
+        this_p->star = calloc(word_count, sizeof(uint64_t));
+        if (!this_p->accept || !this_p->star)
+        {
+            fprintf(stderr, "No enough memory.\n");
+            glob_matcher_term(this_p);
+            return false;
+        }
+
+        accept = this_p->accept;
+        star = this_p->star;
+    }
+    else
+    {
+        memset(this_p->accept_inline, 0, sizeof(this_p->accept_inline));
+        memset(this_p->star_inline, 0, sizeof(this_p->star_inline));
+    }
+
+    bool set[256];
+    int token = 0;
+    char const* p = pattern;
+    while (p < pattern_end)
+    {
+        if (*p == '*')
+        {
+            while (p < pattern_end && *p == '*')
+                ++p;
+
+            glob_matcher_set_bit(star, token);
+        }
+        else if (*p == '?')
+        {
+            for (int c = 1; c < 256; ++c)
+            {
+                if (c != '/')
+                    glob_matcher_set_bit(accept + c * word_count, token);
+            }
+            ++p;
+        }
+        else
+        {
+            char const* next = (*p == '[') ? glob_matcher_parse_class(p, pattern_end, set) : 0;
+            if (next)
+            {
+                for (int c = 0; c < 256; ++c)
+                {
+                    if (set[c])
+                        glob_matcher_set_bit(accept + c * word_count, token);
+                }
+                p = next;
+            }
+            else
+            {
+                glob_matcher_set_bit(accept + (unsigned char)*p * word_count, token);
+                ++p;
+            }
+        }
+
+        ++token;
+    }
+
+    glob_matcher_compile_anchors(this_p, pattern, pattern_end);
+    return true;
+}
+
+void glob_matcher_term(glob_matcher_t* this_p)
+{
+    free(this_p->accept);
+    free(this_p->star);
+    this_p->accept = 0;
+    this_p->star = 0;
+}
+
+static bool glob_matcher_match_words(glob_matcher_t const* this_p, char const* str)
+{
+    int n = this_p->word_count;
+    uint64_t const* accept = this_p->accept;
+    uint64_t const* star = this_p->star;
+
+    uint64_t state[n];
+    uint64_t next[n];
+    memset(state, 0, sizeof(state));
+    state[0] = 1;
+
+    // '*' also matches the empty string, runs of '*' are one token so one step is enough
+    uint64_t carry = 0;
+    for (int w = 0; w < n; ++w)
+    {
+        uint64_t s = state[w] & star[w];
+        state[w] |= (s << 1) | carry;
+        carry = s >> 63;
+    }
+
+    for (; *str; ++str)
+    {
+        uint64_t const* a = accept + (unsigned char)*str * n;
+
+        uint64_t any = 0;
+        carry = 0;
+        for (int w = 0; w < n; ++w)
+        {
+            uint64_t moved = state[w] & a[w];
+            next[w] = (moved << 1) | carry | (state[w] & star[w]);
+            carry = moved >> 63;
+        }
+
+        carry = 0;
+        for (int w = 0; w < n; ++w)
+        {
+            uint64_t s = next[w] & star[w];
+            state[w] = next[w] | (s << 1) | carry;
+            carry = s >> 63;
+            any |= state[w];
+        }
+
+        if (!any)
+            return false;
+    }
+
+    int m = this_p->token_count;
+    return (state[m / 64] >> (m % 64)) & 1;
+}
+
+// literal prefilter
+static inline bool glob_matcher_has_prefix(char const* str, int len, glob_matcher_anchor_t const* a)
+{
+#if defined(GLOB_MATCHER_SSE2)
+    if (len >= 16)
+    {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)str), _mm_loadu_si128((__m128i const*)a->chars));
+        unsigned mask = (1u << a->len) - 1;
+        return ((unsigned)_mm_movemask_epi8(eq) & mask) == mask;
+    }
+#endif
+    return memcmp(str, a->chars, a->len) == 0;
+}
+
+static inline bool glob_matcher_has_suffix(char const* str, int len, glob_matcher_anchor_t const* a)
+{
+    char const* chars_end = a->chars + sizeof(a->chars);
+#if defined(GLOB_MATCHER_SSE2)
+    if (len >= 16)
+    {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)(str + len - 16)), _mm_loadu_si128((__m128i const*)(chars_end - 16)));
+        unsigned mask = (0xffffu << (16 - a->len)) & 0xffffu;
+        return ((unsigned)_mm_movemask_epi8(eq) & mask) == mask;
+    }
+#endif
+    return memcmp(str + len - a->len, chars_end - a->len, a->len) == 0;
+}
+
+static bool glob_matcher_find_scalar(char const* str, int len, char const* lit, int n)
+{
+    char const* end = str + len - n + 1;  // past the last position the literal can start at
+    for (char const* p = str; p < end; ++p)
+    {
+        p = memchr(p, lit[0], end - p);
+        if (!p)
+            return false;
+
+        if (memcmp(p + 1, lit + 1, n - 1) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// the vector searches compare the first and the last character of the literal at
+// 16 (32) positions at once and check the rest only where both are equal
+
+#if defined(GLOB_MATCHER_SSE2)
+static bool glob_matcher_find_sse2(char const* str, int len, char const* lit, int n)
+{
+    __m128i const first = _mm_set1_epi8(lit[0]);
+    __m128i const last = _mm_set1_epi8(lit[n - 1]);
+
+    int i = 0;
+    for (; i + n - 1 + 16 <= len; i += 16)
+    {
+        __m128i f = _mm_cmpeq_epi8(first, _mm_loadu_si128((__m128i const*)(str + i)));
+        __m128i l = _mm_cmpeq_epi8(last, _mm_loadu_si128((__m128i const*)(str + i + n - 1)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(f, l));
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (n <= 2 || memcmp(str + i + bit + 1, lit + 1, n - 2) == 0)
+                return true;
+            mask &= mask - 1;
+        }
+    }
+
+    return glob_matcher_find_scalar(str + i, len - i, lit, n);
+}
+#endif
+
+#if defined(GLOB_MATCHER_AVX2)
+__attribute__((target("avx2")))
+static bool glob_matcher_find_avx2(char const* str, int len, char const* lit, int n)
+{
+    __m256i const first = _mm256_set1_epi8(lit[0]);
+    __m256i const last = _mm256_set1_epi8(lit[n - 1]);
+
+    int i = 0;
+    for (; i + n - 1 + 32 <= len; i += 32)
+    {
+        __m256i f = _mm256_cmpeq_epi8(first, _mm256_loadu_si256((__m256i const*)(str + i)));
+        __m256i l = _mm256_cmpeq_epi8(last, _mm256_loadu_si256((__m256i const*)(str + i + n - 1)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(f, l));
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (n <= 2 || memcmp(str + i + bit + 1, lit + 1, n - 2) == 0)
+                return true;
+            mask &= mask - 1;
+        }
+    }
+
+    return glob_matcher_find_scalar(str + i, len - i, lit, n);
+}
+#endif
+
+static bool glob_matcher_prefilter(glob_matcher_t const* this_p, char const* str, int len)
+{
+    if (len < this_p->min_len)
+        return false;
+
+    if (this_p->prefix.len && !glob_matcher_has_prefix(str, len, &this_p->prefix))
+        return false;
+
+    if (this_p->suffix.len && !glob_matcher_has_suffix(str, len, &this_p->suffix))
+        return false;
+
+    int n = this_p->infix.len;
+    if (!n)
+        return true;
+
+    // the infix lies between the prefix and the suffix
+    char const* s = str + this_p->prefix.len;
+    int s_len = len - this_p->prefix.len - this_p->suffix.len;
+    if (s_len < n)
+        return false;
+
+#if defined(GLOB_MATCHER_AVX2)
+    if (this_p->is_avx2)
+        return glob_matcher_find_avx2(s, s_len, this_p->infix.chars, n);
+#endif
+#if defined(GLOB_MATCHER_SSE2)
+    return glob_matcher_find_sse2(s, s_len, this_p->infix.chars, n);
+#else
+    return glob_matcher_find_scalar(s, s_len, this_p->infix.chars, n);
+#endif
+}
+
+bool glob_matcher_match(glob_matcher_t const* this_p, char const* str)
+{
+    int len = strlen(str);
+    if (!glob_matcher_prefilter(this_p, str, len))
+        return false;
+
+    if (this_p->is_anchored_exact)
+        return true;
+
+    if (this_p->word_count > glob_matcher_WORDS_INLINE)
+        return glob_matcher_match_words(this_p, str);
+
+    uint64_t const* accept = this_p->accept_inline;
+    uint64_t const star = this_p->star_inline[0];
+
+    uint64_t state = 1;
+    state |= (state & star) << 1;
+
+    for (; *str; ++str)
+    {
+        state = ((state & accept[(unsigned char)*str]) << 1) | (state & star);
+        state |= (state & star) << 1;
+
+        if (!state)
+            return false;
+    }
+
+    return (state >> this_p->token_count) & 1;
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+
+#include <stdint.h>
+
+// compiled form of one path segment of a glob pattern
+// supports '*', '?', '[abc]', '[a-z]' and '[!x]' (or '[^x]')
+// the pattern is run as a bit-parallel NFA, one bit per pattern position, so a name
+// is matched in a single pass over its characters without any backtracking
+// before that, the literal anchors of the pattern (prefix, suffix and the longest
+// literal run in between) reject most names with a few vector compares
+
+#define glob_matcher_WORDS_INLINE 1
+#define glob_matcher_ANCHOR_MAX   16
+
+typedef struct glob_matcher_anchor_s
+{
+	int len;                                 // 0 when the pattern has no such literal
+	char chars[2 * glob_matcher_ANCHOR_MAX]; // padded so 16 bytes can always be loaded
+}
+glob_matcher_anchor_t;
+
+typedef struct glob_matcher_s
+{
+	int token_count;      // number of pattern positions, runs of '*' count as one
+	int word_count;       // 64 bit words of a state set, (token_count + 1) bits
+	uint64_t* accept;     // [256][word_count], bit i: token i consumes the char
+	uint64_t* star;       // [word_count], bit i: token i is '*'
+
+	// used instead of 'accept' and 'star' (left 0) when a state set fits in
+	// glob_matcher_WORDS_INLINE words, the common case
+	uint64_t accept_inline[256 * glob_matcher_WORDS_INLINE];
+	uint64_t star_inline[glob_matcher_WORDS_INLINE];
+
+	int min_len;                   // number of tokens that consume a character
+	glob_matcher_anchor_t prefix;  // left aligned in 'chars'
+	glob_matcher_anchor_t suffix;  // right aligned in 'chars'
+	glob_matcher_anchor_t infix;   // left aligned, longest literal run between the two
+	bool is_anchored_exact;        // the pattern is 'prefix*suffix', the anchors decide the match
+	bool is_avx2;                  // the infix search uses AVX2
+}
+glob_matcher_t;
+
+// Construction
+bool glob_matcher_compile(glob_matcher_t* this_p, char const* pattern, char const* pattern_end);
+void    glob_matcher_term(glob_matcher_t* this_p);
+
+// Methods
+bool   glob_matcher_match(glob_matcher_t const* this_p, char const* str);
@@ -0,0 +1,516 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "globresult.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+static bool glob_result_reserve(void** ptr, size_t* cap, size_t size, size_t item_size)
+{
+    if (size <= *cap)
+        return true;
+
+    size_t new_cap = *cap ? *cap : 64;
+    while (new_cap < size)
+        new_cap *= 2;
+
+    void* p = realloc(*ptr, new_cap * item_size);
+    if (!p)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return false;
+    }
+
+    *ptr = p;
+    *cap = new_cap;
+    return true;
+}
+
+// returns the offset of the copy of 'name' in 'names', or UINT_MAX on a failure
+static unsigned glob_result_name_push(glob_result_t* this_p, char const* name, size_t name_len)
+{
+    size_t offset = this_p->names_size;
+    if (offset + name_len + 1 >= UINT_MAX)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return UINT_MAX;
+    }
+
+    if (!glob_result_reserve((void**)&this_p->names, &this_p->names_cap, offset + name_len + 1, sizeof(char)))
+        return UINT_MAX;
+
+    memcpy(this_p->names + offset, name, name_len);
+    this_p->names[offset + name_len] = 0;
+    this_p->names_size += name_len + 1;
+    return (unsigned)offset;
+}
+
+void glob_result_init(glob_result_t* this_p)
+{
+    memset(this_p, 0, sizeof(*this_p));
+}
+
+void glob_result_term(glob_result_t* this_p)
+{
+    free(this_p->names);
+    free(this_p->dirs);
+    free(this_p->files);
+    glob_result_init(this_p);
+}
+
+int glob_result_dir_push(glob_result_t* this_p, int parent, char const* name, size_t name_len)
+{
+    size_t cap = this_p->dir_cap;
+    if (this_p->dir_count == INT_MAX || !glob_result_reserve((void**)&this_p->dirs, &cap, this_p->dir_count + 1, sizeof(glob_result_dir_t)))
+        return -1;
+    this_p->dir_cap = (int)(cap > INT_MAX ? INT_MAX : cap);
+
+    unsigned offset = glob_result_name_push(this_p, name, name_len);
+    if (offset == UINT_MAX)
+        return -1;
+
+    glob_result_dir_t* d = &this_p->dirs[this_p->dir_count];
+    d->parent = parent;
+    d->name = offset;
+    d->path_len = (parent < 0) ? name_len : this_p->dirs[parent].path_len + 1 + name_len;
+    return this_p->dir_count++;
+}
+
+void glob_result_dir_drop_if_empty(glob_result_t* this_p, int dir)
+{
+    // the files of a directory and of its subdirectories are pushed after it
+    if (dir < 0 || dir != this_p->dir_count - 1)
+        return;
+
+    if (this_p->file_count && this_p->files[this_p->file_count - 1].dir >= dir)
+        return;
+
+    this_p->names_size = this_p->dirs[dir].name;
+    --(this_p->dir_count);
+}
+
+bool glob_result_file_push(glob_result_t* this_p, int dir, int tag, char const* name, size_t name_len)
+{
+    if (!glob_result_reserve((void**)&this_p->files, &this_p->file_cap, this_p->file_count + 1, sizeof(glob_result_file_t)))
+        return false;
+
+    unsigned offset = glob_result_name_push(this_p, name, name_len);
+    if (offset == UINT_MAX)
+        return false;
+
+    glob_result_file_t* f = &this_p->files[this_p->file_count++];
+    f->dir = dir;
+    f->tag = tag;
+    f->name = offset;
+    f->name_len = (unsigned)name_len;
+    return true;
+}
+
+bool glob_result_merge(glob_result_t* this_p, glob_result_t const* other, size_t const* order, size_t count, int tag)
+{
+    if (!order)
+        count = other->file_count;
+
+    if (!count)
+        return true;
+
+    size_t names_base = this_p->names_size;
+    int dirs_base = this_p->dir_count;
+
+    size_t dir_cap = this_p->dir_cap;
+    if (names_base + other->names_size >= UINT_MAX || (long long)dirs_base + other->dir_count > INT_MAX)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return false;
+    }
+
+    if (!glob_result_reserve((void**)&this_p->names, &this_p->names_cap, names_base + other->names_size, sizeof(char))
+        || !glob_result_reserve((void**)&this_p->dirs, &dir_cap, dirs_base + other->dir_count, sizeof(glob_result_dir_t))
+        || !glob_result_reserve((void**)&this_p->files, &this_p->file_cap, this_p->file_count + count, sizeof(glob_result_file_t)))
+        return false;
+    this_p->dir_cap = (int)(dir_cap > INT_MAX ? INT_MAX : dir_cap);
+
+    // the names and the directories are moved as they are, only their references change
+    memcpy(this_p->names + names_base, other->names, other->names_size);
+    this_p->names_size += other->names_size;
+
+    for (int i = 0; i < other->dir_count; ++i)
+    {
+        glob_result_dir_t d = other->dirs[i];
+        d.name += (unsigned)names_base;
+        if (d.parent >= 0)
+            d.parent += dirs_base;
+        this_p->dirs[this_p->dir_count++] = d;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        glob_result_file_t f = other->files[order ? order[i] : i];
+        f.dir += dirs_base;
+        f.name += (unsigned)names_base;
+        if (tag >= 0)
+            f.tag = tag;
+        this_p->files[this_p->file_count++] = f;
+    }
+
+    return true;
+}
+
+bool glob_result_group_by_tag(glob_result_t* this_p, int tag_count, size_t* firsts)
+{
+    memset(firsts, 0, (tag_count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < this_p->file_count; ++i)
+        ++firsts[this_p->files[i].tag + 1];
+
+    for (int t = 0; t < tag_count; ++t)
+        firsts[t + 1] += firsts[t];
+
+    bool is_grouped = true;
+    for (size_t i = 1; is_grouped && i < this_p->file_count; ++i)
+        is_grouped = this_p->files[i - 1].tag <= this_p->files[i].tag;
+
+    if (is_grouped)
+        return true;
+
+    // counting sort, stable
+    glob_result_file_t* files = malloc(this_p->file_cap * sizeof(glob_result_file_t));
+    size_t* next = malloc(tag_count * sizeof(size_t));
+    if (!files || !next)
+    {
+        free(files);
+        free(next);
+        fprintf(stderr, "No enough memory.\n");
+        return false;
+    }
+
+    memcpy(next, firsts, tag_count * sizeof(size_t));
+    for (size_t i = 0; i < this_p->file_count; ++i)
+        files[next[this_p->files[i].tag]++] = this_p->files[i];
+
+    free(next);
+    free(this_p->files);
+    this_p->files = files;
+    return true;
+}
+
+size_t glob_result_path_len(glob_result_t const* this_p, size_t file)
+{
+    glob_result_file_t const* f = &this_p->files[file];
+    return this_p->dirs[f->dir].path_len + 1 + f->name_len;
+}
+
+void glob_result_path_copy(glob_result_t const* this_p, size_t file, char* buf)
+{
+    // filled from the end, the directories are reached from the file up
+    glob_result_file_t const* f = &this_p->files[file];
+    size_t pos = glob_result_path_len(this_p, file);
+    buf[pos] = 0;
+
+    pos -= f->name_len;
+    memcpy(buf + pos, this_p->names + f->name, f->name_len);
+
+    for (int dir = f->dir; dir >= 0; dir = this_p->dirs[dir].parent)
+    {
+        glob_result_dir_t const* d = &this_p->dirs[dir];
+        buf[--pos] = '/';
+
+        size_t name_len = (d->parent < 0) ? d->path_len : d->path_len - this_p->dirs[d->parent].path_len - 1;
+        pos -= name_len;
+        memcpy(buf + pos, this_p->names + d->name, name_len);
+    }
+}
+
+int glob_result_path_compare(glob_result_t const* this_p, size_t a, size_t b)
+{
+    // files of the same directory differ in their names only
+    glob_result_file_t const* fa = &this_p->files[a];
+    glob_result_file_t const* fb = &this_p->files[b];
+    if (fa->dir == fb->dir)
+        return strcmp(this_p->names + fa->name, this_p->names + fb->name);
+
+    char path_a[glob_result_path_len(this_p, a) + 1];
+    char path_b[glob_result_path_len(this_p, b) + 1];
+    glob_result_path_copy(this_p, a, path_a);
+    glob_result_path_copy(this_p, b, path_b);
+    return strcmp(path_a, path_b);
+}
+
+bool glob_result_paths_append(glob_result_t const* this_p, size_t first, size_t count, plst_t* paths)
+{
+    for (size_t i = first; i < first + count; ++i)
+    {
+        size_t l = glob_result_path_len(this_p, i) + 1;
+        char* path = paths->arena ? arena_alloc(paths->arena, l) : malloc(l);
+        if (!path)
+        {
+            if (!paths->arena)
+                fprintf(stderr, "No enough memory.\n");
+            return false;
+        }
+
+        glob_result_path_copy(this_p, i, path);
+        if (!plst_append(paths, path))
+        {
+            if (!paths->arena)
+                free(path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// sorting
+// the paths are sorted with a multikey quicksort (Bentley and Sedgewick) that caches
+// eight characters of every path at once (Rantala): the files are partitioned on those
+// eight characters as one integer and only the paths equal on them are looked at
+// further, so a prefix shared by many paths is not compared again and again as with
+// qsort() and strcmp(); the characters come from the name buffer and from the paths
+// of the directories, built once
+
+#define glob_result_SORT_SMALL 16    // fewer files are sorted by insertion
+
+typedef struct glob_result_key_s
+{
+    uint64_t cache;        // the characters at the current depth, the first one highest
+    char const* dir;       // the whole path of the directory of the file
+    char const* name;
+    unsigned dir_len;
+    unsigned len;          // of the whole path of the file
+    size_t file;
+}
+glob_result_key_t;
+
+static inline int glob_result_key_at(glob_result_key_t const* key, size_t depth)
+{
+    if (depth < key->dir_len)
+        return (unsigned char)key->dir[depth];
+    if (depth == key->dir_len)
+        return '/';
+    if (depth < key->len)
+        return (unsigned char)key->name[depth - key->dir_len - 1];
+    return 0;
+}
+
+static inline uint64_t glob_result_load_word(char const* p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+// the eight characters at 'depth', 0 past the end of the path
+static inline uint64_t glob_result_key_word(glob_result_key_t const* key, size_t depth)
+{
+    if (depth + 8 <= key->dir_len)
+        return glob_result_load_word(key->dir + depth);
+
+    if (depth > key->dir_len && depth + 8 <= key->len)
+        return glob_result_load_word(key->name + (depth - key->dir_len - 1));
+
+    uint64_t w = 0;
+    for (size_t i = 0; i < 8; ++i)
+        w = (w << 8) | (uint64_t)glob_result_key_at(key, depth + i);
+    return w;
+}
+
+static void glob_result_keys_fill(glob_result_key_t* keys, size_t count, size_t depth)
+{
+    for (size_t i = 0; i < count; ++i)
+        keys[i].cache = glob_result_key_word(&keys[i], depth);
+}
+
+// compares two paths known to be equal up to 'depth'
+static int glob_result_key_compare(glob_result_key_t const* a, glob_result_key_t const* b, size_t depth)
+{
+    if (a->dir == b->dir)
+    {
+        size_t offset = (depth > a->dir_len) ? depth - a->dir_len - 1 : 0;
+        return strcmp(a->name + offset, b->name + offset);
+    }
+
+    for (;; ++depth)
+    {
+        int ca = glob_result_key_at(a, depth);
+        int cb = glob_result_key_at(b, depth);
+        if (ca != cb || !ca)
+            return ca - cb;
+    }
+}
+
+// compares two paths known to be equal up to 'depth', where their caches are
+static int glob_result_key_compare_cached(glob_result_key_t const* a, glob_result_key_t const* b, size_t depth)
+{
+    if (a->cache != b->cache)
+        return (a->cache < b->cache) ? -1 : 1;
+
+    // both ended within the cached characters
+    if (!(a->cache & 0xff))
+        return 0;
+
+    return glob_result_key_compare(a, b, depth + 8);
+}
+
+static inline void glob_result_key_swap(glob_result_key_t* keys, size_t i, size_t j)
+{
+    glob_result_key_t t = keys[i];
+    keys[i] = keys[j];
+    keys[j] = t;
+}
+
+// the caches of 'keys' hold the characters at 'depth'
+static void glob_result_keys_sort(glob_result_key_t* keys, size_t count, size_t depth)
+{
+    while (count > glob_result_SORT_SMALL)
+    {
+        // median of three as the pivot
+        uint64_t a = keys[0].cache;
+        uint64_t b = keys[count / 2].cache;
+        uint64_t c = keys[count - 1].cache;
+        uint64_t pivot = (a < b) ? ((b < c) ? b : (a < c) ? c : a) : ((a < c) ? a : (b < c) ? c : b);
+
+        // three way partition: [0, lt) below the pivot, [lt, gt) equal, [gt, count) above
+        size_t lt = 0, i = 0, gt = count;
+        while (i < gt)
+        {
+            uint64_t w = keys[i].cache;
+            if (w < pivot)
+                glob_result_key_swap(keys, lt++, i++);
+            else if (w > pivot)
+                glob_result_key_swap(keys, i, --gt);
+            else
+                ++i;
+        }
+
+        glob_result_keys_sort(keys, lt, depth);
+        glob_result_keys_sort(keys + gt, count - gt, depth);
+
+        // the paths equal to the pivot continue with the next characters, unless they ended
+        if (!(pivot & 0xff))
+            return;
+
+        keys += lt;
+        count = gt - lt;
+        depth += 8;
+        glob_result_keys_fill(keys, count, depth);
+    }
+
+    for (size_t i = 1; i < count; ++i)
+    {
+        for (size_t j = i; j > 0 && glob_result_key_compare_cached(&keys[j - 1], &keys[j], depth) > 0; --j)
+            glob_result_key_swap(keys, j - 1, j);
+    }
+}
+
+// the whole paths of the directories, a parent is always pushed before its subdirectories
+static char* glob_result_dir_paths(glob_result_t const* this_p, size_t* offsets)
+{
+    size_t size = 0;
+    for (int i = 0; i < this_p->dir_count; ++i)
+    {
+        offsets[i] = size;
+        size += this_p->dirs[i].path_len + 1;
+    }
+
+    char* paths = malloc(size ? size : 1);
+    if (!paths)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return 0;
+    }
+
+    for (int i = 0; i < this_p->dir_count; ++i)
+    {
+        glob_result_dir_t const* d = &this_p->dirs[i];
+        char* p = paths + offsets[i];
+        if (d->parent < 0)
+        {
+            memcpy(p, this_p->names + d->name, d->path_len);
+        }
+        else
+        {
+            size_t parent_len = this_p->dirs[d->parent].path_len;
+            memcpy(p, paths + offsets[d->parent], parent_len);
+            p[parent_len] = '/';
+            memcpy(p + parent_len + 1, this_p->names + d->name, d->path_len - parent_len - 1);
+        }
+        p[d->path_len] = 0;
+    }
+
+    return paths;
+}
+
+bool glob_result_sort_by_tag(glob_result_t* this_p, int tag_count)
+{
+    size_t firsts[tag_count + 1];
+    if (!glob_result_group_by_tag(this_p, tag_count, firsts))
+        return false;
+
+    if (this_p->file_count < 2)
+        return true;
+
+    size_t* offsets = malloc(this_p->dir_count * sizeof(size_t));
+    glob_result_key_t* keys = malloc(this_p->file_count * sizeof(glob_result_key_t));
+    glob_result_file_t* files = malloc(this_p->file_cap * sizeof(glob_result_file_t));
+    if (!offsets || !keys || !files)
+    {
+        free(offsets);
+        free(keys);
+        free(files);
+        fprintf(stderr, "No enough memory.\n");
+        return false;
+    }
+
+    char* dir_paths = glob_result_dir_paths(this_p, offsets);
+    if (!dir_paths)
+    {
+        free(offsets);
+        free(keys);
+        free(files);
+        return false;
+    }
+
+    for (size_t i = 0; i < this_p->file_count; ++i)
+    {
+        glob_result_file_t const* f = &this_p->files[i];
+        glob_result_key_t* key = &keys[i];
+        key->dir = dir_paths + offsets[f->dir];
+        key->dir_len = (unsigned)this_p->dirs[f->dir].path_len;
+        key->name = this_p->names + f->name;
+        key->len = key->dir_len + 1 + f->name_len;
+        key->file = i;
+    }
+
+    glob_result_keys_fill(keys, this_p->file_count, 0);
+
+    size_t count = 0;
+    for (int t = 0; t < tag_count; ++t)
+    {
+        glob_result_key_t* group = keys + firsts[t];
+        size_t group_count = firsts[t + 1] - firsts[t];
+        glob_result_keys_sort(group, group_count, 0);
+
+        // a nested '**' reaches the same file through every matching ancestor
+        for (size_t i = 0; i < group_count; ++i)
+        {
+            if (!i || glob_result_key_compare(&group[i - 1], &group[i], 0) != 0)
+                files[count++] = this_p->files[group[i].file];
+        }
+    }
+
+    free(this_p->files);
+    this_p->files = files;
+    this_p->file_count = count;
+
+    free(dir_paths);
+    free(keys);
+    free(offsets);
+    return true;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+#include "base/plst.h"
+
+#include <stddef.h>
+
+// compact storage of the files a wildcard expansion matched
+// a path is not stored whole: every file keeps its name and the index of its directory,
+// every directory its name and the index of its parent, all the names in one buffer,
+// so the prefix shared by the matches of a directory is stored once and a large
+// expansion makes a few reallocations instead of an allocation per match
+// the full paths are built only when they are needed, e.g. for the argv of a command
+
+typedef struct glob_result_dir_s
+{
+    int parent;            // -1 for a directory whose name is its whole path
+    unsigned name;         // offset of the 0 terminated name in 'names'
+    size_t path_len;       // length of the whole path
+}
+glob_result_dir_t;
+
+typedef struct glob_result_file_s
+{
+    int dir;
+    int tag;               // which of the expanded patterns the file matched
+    unsigned name;
+    unsigned name_len;
+}
+glob_result_file_t;
+
+typedef struct glob_result_s
+{
+    char* names;
+    size_t names_size;
+    size_t names_cap;
+
+    glob_result_dir_t* dirs;
+    int dir_count;
+    int dir_cap;
+
+    glob_result_file_t* files;
+    size_t file_count;
+    size_t file_cap;
+}
+glob_result_t;
+
+// Construction
+void glob_result_init(glob_result_t* this_p);
+void glob_result_term(glob_result_t* this_p);
+
+// Building
+// returns the index of the new directory, -1 on a failure
+int  glob_result_dir_push(glob_result_t* this_p, int parent, char const* name, size_t name_len);
+// drops 'dir' if it is the last directory and no file was added to it or under it
+void glob_result_dir_drop_if_empty(glob_result_t* this_p, int dir);
+bool glob_result_file_push(glob_result_t* this_p, int dir, int tag, char const* name, size_t name_len);
+
+// appends the files 'order[0..count)' of 'other' (all of them in order if 'order' is 0)
+// with their directories; the offsets and indexes of 'other' are relocated past the
+// ones of this result, a 'tag' of -1 keeps the tags of 'other'
+bool glob_result_merge(glob_result_t* this_p, glob_result_t const* other, size_t const* order, size_t count, int tag);
+
+// reorders the files by tag, keeping the order of the files of a tag; the files of tag
+// 't' are then 'firsts[t]' to 'firsts[t + 1]', 'firsts' has 'tag_count + 1' items
+bool glob_result_group_by_tag(glob_result_t* this_p, int tag_count, size_t* firsts);
+
+// reorders the files by tag as glob_result_group_by_tag() does, then sorts the files
+// of every tag by their paths, byte by byte, and drops the repeated paths of a tag
+bool glob_result_sort_by_tag(glob_result_t* this_p, int tag_count);
+
+// Paths
+size_t glob_result_path_len(glob_result_t const* this_p, size_t file);
+// writes the path of 'file' and a terminating 0 to 'buf', which holds path_len + 1 chars
+void   glob_result_path_copy(glob_result_t const* this_p, size_t file, char* buf);
+int    glob_result_path_compare(glob_result_t const* this_p, size_t a, size_t b);
+// appends copies of the paths of files 'first' to 'first + count' to 'paths'
+bool   glob_result_paths_append(glob_result_t const* this_p, size_t first, size_t count, plst_t* paths);
@@ -5,11 +5,107 @@
 
 #include "lexer.h"
 
+#include <stdint.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define LEXER_SSE2
+#include <emmintrin.h>
+#endif
+
+// the characters a '\' makes part of a PATH token
+static bool lexer_is_escapable(char c)
+{
+	return c == ' ' || c == '<' || c == '>' || c == '|' || c == '&' || c == '\\';
+}
+
+#if defined(LEXER_SSE2)
+// the characters that end a PATH token or start an escape in it, 16 at once
+static inline unsigned lexer_delimiter_mask(__m128i v)
+{
+	__m128i m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	return (unsigned)_mm_movemask_epi8(m);
+}
+#else
+// the characters that end a PATH token or start an escape in it
+static bool lexer_is_delimiter(char c)
+{
+	return c == 0 || c == '\n' || c == ' ' || c == '<' || c == '>' || c == '|' || c == '&' || c == '\\';
+}
+#endif
+
+// returns the first delimiter at or after 'p', 16 characters are examined at once
+static char const* lexer_find_delimiter(char const* p)
+{
+#if defined(LEXER_SSE2)
+	// aligned loads do not cross into a page past the terminating 0 of the line, the
+	// bytes before 'p' in the first block are masked out
+	uintptr_t offset = (uintptr_t)p & 15;
+	char const* block = p - offset;
+	unsigned mask = lexer_delimiter_mask(_mm_load_si128((__m128i const*)block)) & (0xffffu << offset);
+	while (!mask)
+	{
+		block += 16;
+		mask = lexer_delimiter_mask(_mm_load_si128((__m128i const*)block));
+	}
+	return block + __builtin_ctz(mask);
+#else
+	while (!lexer_is_delimiter(*p))
+		++p;
+	return p;
+#endif
+}
+
+// lexes the PATH token starting at 's', the first character is part of it whatever it
+// is, unless it starts an escape; the token is a view into the line, only a token with
+// escapes is copied, with the escapes translated on the way
+static char const* lexer_path(char const* s, token_t* t)
+{
+	char const* cur = lexer_find_delimiter(*s == '\\' ? s : s + 1);
+	if (*cur != '\\')
+	{
+		token_compose(t, TOKEN_PATH, s, cur - s);
+		return cur;
+	}
+
+	dstr_t* text = &t->token_text;
+	bool result = dstr_assign_view(text, s, cur - s);
+
+	while (result && *cur == '\\')
+	{
+		// a '\' before any other character is kept as it is
+		bool is_escape = lexer_is_escapable(cur[1]);
+		result = dstr_append_view(text, is_escape ? cur + 1 : cur, 1);
+		cur += is_escape ? 2 : 1;
+
+		char const* end = lexer_find_delimiter(cur);
+		result = result && dstr_append_view(text, cur, end - cur);
+		cur = end;
+	}
+
+	if (!result)
+	{
+		token_compose(t, TOKEN_ERROR, s, cur - s);
+		return cur;
+	}
+
+	t->token_type = TOKEN_PATH;
+	t->ptr = text->ptr;
+	t->len = text->len;
+	return cur;
+}
+
 char const* lexer(char const* cur, token_t* t)
 {
 	char const* YYMARKER;
 
-    #line 15 "lexer.re2c"
+    #line 111 "lexer.re2c"
 
 
 	while(1)
@@ -17,7 +113,7 @@ char const* lexer(char const* cur, token_t* t)
 		char const* s = cur;
 
     
-#line 21 "lexout.c"
+#line 117 "lexout.c"
 {
 	char yych;
 	yych = *cur;
@@ -54,6 +150,7 @@ char const* lexer(char const* cur, token_t* t)
 		} else {
 			if (yych <= 'o') {
 				if (yych == 'e') goto yy9;
+				if (yych == 'h') goto yy21;
 				goto yy2;
 			} else {
 				if (yych <= 'p') goto yy10;
@@ -64,47 +161,47 @@ char const* lexer(char const* cur, token_t* t)
 	}
 yy1:
 	++cur;
-#line 25 "lexer.re2c"
+#line 121 "lexer.re2c"
 	{
 								--cur;
 								token_compose(t, TOKEN_EOF, s, 0);
 								return cur;
 							}
-#line 74 "lexout.c"
+#line 171 "lexout.c"
 yy2:
 	++cur;
 yy3:
-#line 78 "lexer.re2c"
+#line 180 "lexer.re2c"
 	{
-								goto path;
+								return lexer_path(s, t);
 							}
-#line 82 "lexout.c"
+#line 179 "lexout.c"
 yy4:
 	yych = *++cur;
 	if (yych == ' ') goto yy4;
-#line 31 "lexer.re2c"
+#line 127 "lexer.re2c"
 	{ continue; }
-#line 88 "lexout.c"
+#line 185 "lexout.c"
 yy5:
 	yych = *++cur;
 	if (yych == '&') goto yy12;
 	goto yy3;
 yy6:
 	++cur;
-#line 52 "lexer.re2c"
+#line 154 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_REDIRECTION_IN, s, 1);
 								return cur;
 							}
-#line 100 "lexout.c"
+#line 197 "lexout.c"
 yy7:
 	++cur;
-#line 58 "lexer.re2c"
+#line 160 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_REDIRECTION_OUT, s, 1);
 								return cur;
 							}
-#line 108 "lexout.c"
+#line 205 "lexout.c"
 yy8:
 	yych = *++cur;
 	if (yych == 'D') goto yy13;
@@ -123,28 +220,28 @@ yy10:
 yy11:
 	yych = *++cur;
 	if (yych == '|') goto yy17;
-#line 63 "lexer.re2c"
+#line 165 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_PIPE, s, 1);
 								return cur;
 							}
-#line 132 "lexout.c"
+#line 229 "lexout.c"
 yy12:
 	++cur;
-#line 73 "lexer.re2c"
+#line 175 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_AND, s, 2);
 								return cur;
 							}
-#line 140 "lexout.c"
+#line 237 "lexout.c"
 yy13:
 	++cur;
-#line 34 "lexer.re2c"
+#line 130 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_COMMAND_CD, s, 2);
 								return cur;
 							}
-#line 148 "lexout.c"
+#line 245 "lexout.c"
 yy14:
 	yych = *++cur;
 	if (yych == 'I') goto yy18;
@@ -159,12 +256,12 @@ yy16:
 	goto yy15;
 yy17:
 	++cur;
-#line 68 "lexer.re2c"
+#line 170 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_OR, s, 2);
 								return cur;
 							}
-#line 168 "lexout.c"
+#line 265 "lexout.c"
 yy18:
 	yych = *++cur;
 	if (yych == 'T') goto yy20;
@@ -172,71 +269,66 @@ yy18:
 	goto yy15;
 yy19:
 	++cur;
-#line 40 "lexer.re2c"
+#line 136 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_COMMAND_PWD, s, 3);
 								return cur;
 							}
-#line 181 "lexout.c"
+#line 278 "lexout.c"
 yy20:
 	++cur;
-#line 46 "lexer.re2c"
+#line 142 "lexer.re2c"
 	{
 								token_compose(t, TOKEN_COMMAND_EXIT, s, 4);
 								return cur;
 							}
-#line 189 "lexout.c"
-}
-#line 81 "lexer.re2c"
-
-
-	}
-
-path:
-	;
-	char const* path_start = cur - 1;
-	while(1)
-	{
-    
-#line 202 "lexout.c"
-{
-	char yych;
-	yych = *cur;
-	if (yych <= '&') {
+#line 286 "lexout.c"
+yy21:
+	yych = *(YYMARKER = ++cur);
+	if (yych == 'a') goto yy22;
+	goto yy3;
+yy22:
+	yych = *++cur;
+	if (yych == 's') goto yy23;
+	goto yy15;
+yy23:
+	yych = *++cur;
+	if (yych == 'h') goto yy24;
+	goto yy15;
+yy24:
+	yych = *++cur;
+	if (yych <= '%') {
 		if (yych <= '\n') {
-			if (yych <= 0x00) goto yy22;
-			if (yych <= '\t') goto yy23;
+			if (yych <= 0x00) goto yy25;
+			if (yych <= '\t') goto yy15;
+			goto yy25;
 		} else {
-			if (yych == ' ') goto yy22;
-			if (yych <= '%') goto yy23;
+			if (yych == ' ') goto yy25;
+			goto yy15;
 		}
 	} else {
-		if (yych <= '=') {
-			if (yych != '<') goto yy23;
+		if (yych <= '<') {
+			if (yych <= '&') goto yy25;
+			if (yych <= ';') goto yy15;
+			goto yy25;
 		} else {
-			if (yych <= '>') goto yy22;
-			if (yych != '|') goto yy23;
+			if (yych == '>') goto yy25;
+			if (yych == '|') goto yy25;
+			goto yy15;
 		}
 	}
-yy22:
+yy25:
 	++cur;
-#line 92 "lexer.re2c"
+	cur -= 1;
+#line 149 "lexer.re2c"
 	{
-								--cur;
-								token_compose(t, TOKEN_PATH, path_start, cur - path_start);
+								token_compose(t, TOKEN_COMMAND_HASH, s, 4);
 								return cur;
 							}
-#line 230 "lexout.c"
-yy23:
-	++cur;
-#line 99 "lexer.re2c"
-	{
-								continue;
-							}
-#line 237 "lexout.c"
+#line 329 "lexout.c"
 }
-#line 102 "lexer.re2c"
+#line 183 "lexer.re2c"
 
 
 	}
-}
\ No newline at end of file
+}
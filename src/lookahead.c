@@ -0,0 +1,339 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "lookahead.h"
+#include "parser.h"
+#include "program.h"
+#include "command.h"
+#include "pathcache.h"
+#include "scriptcache.h"
+#include "prefetch.h"
+#include "builtin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+
+typedef struct lookahead_stats_s
+{
+    long prepared;          // lines prepared by the helper
+    long ready;             // lines prepared before the shell asked for them
+    long barriers;          // lines the helper waited for before going on
+    long resolved;          // executables resolved ahead
+    long directories;       // directories read ahead
+}
+lookahead_stats_t;
+
+static lookahead_stats_t lookahead_stats;
+
+// a line whose run could change what the next lines resolve or expand to
+static bool lookahead_is_barrier(program_t* program)
+{
+    for (dlst_len_t i = 0; i < program->code.len; ++i)
+    {
+        program_instr_t* instr = dlst_at(&program->code, i);
+        if (instr->op != PROGRAM_OP_PIPELINE)
+            continue;
+
+        for (dlst_len_t j = 0; j < instr->pipeline.len; ++j)
+        {
+            command_t const* c = dlst_at(&instr->pipeline, j);
+            if (c->command_type == COMMAND_BUILTIN_CD || !dstr_is_null(&c->redir_out_to))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+// reads the directory a pattern starts its walk in, the expansion then finds its
+// entries in the kernel caches
+static void lookahead_warm_directory(char const* pattern)
+{
+    char const* wildcard = strpbrk(pattern, "*?[");
+    if (!wildcard)
+        return;
+
+    // up to the last '/' before the wildcard
+    char const* slash = 0;
+    for (char const* p = pattern; p < wildcard; ++p)
+    {
+        if (*p == '/')
+            slash = p;
+    }
+
+    char dname[4096];
+    size_t len = slash ? (size_t)(slash - pattern) : 0;
+    if (len >= sizeof(dname))
+        return;
+
+    if (!slash)
+        strcpy(dname, ".");
+    else if (len == 0)
+        strcpy(dname, "/");
+    else
+    {
+        memcpy(dname, pattern, len);
+        dname[len] = 0;
+    }
+
+    DIR* d = opendir(dname);
+    if (!d)
+        return;
+
+    while (readdir(d))
+        ;
+
+    closedir(d);
+    ++lookahead_stats.directories;
+}
+
+// a relative path is left alone after a 'cd' of the line, it could name another file
+static void lookahead_prefetch(char const* path, bool is_cwd_changed)
+{
+    if (!is_cwd_changed || path[0] == '/')
+        prefetch_file(path);
+}
+
+static void lookahead_warm(program_t* program)
+{
+    dstr_t resolved;
+    dstr_init(&resolved);
+
+    bool is_cwd_changed = false;
+    for (dlst_len_t i = 0; i < program->code.len; ++i)
+    {
+        program_instr_t* instr = dlst_at(&program->code, i);
+        if (instr->op != PROGRAM_OP_PIPELINE)
+            continue;
+
+        for (dlst_len_t j = 0; j < instr->pipeline.len; ++j)
+        {
+            command_t const* c = dlst_at(&instr->pipeline, j);
+            if (c->command_type == COMMAND_BUILTIN_CD)
+                is_cwd_changed = true;
+
+            if (c->command_type != COMMAND_EXTERNAL)
+                continue;
+
+            // a builtin runs in the shell and does not read its input
+            if (!builtin_find(c->executable.ptr))
+            {
+                if (!strchr(c->executable.ptr, '/'))
+                {
+                    if (path_cache_lookup(c->executable.ptr, &resolved))
+                        prefetch_file(resolved.ptr);
+                    ++lookahead_stats.resolved;
+                }
+                else
+                    lookahead_prefetch(c->executable.ptr, is_cwd_changed);
+
+                if (!dstr_is_null(&c->redir_in_from))
+                    lookahead_prefetch(c->redir_in_from.ptr, is_cwd_changed);
+            }
+
+            for (plst_len_t k = 1; k < c->args.len; ++k)
+            {
+                if (c->args.ptr[k])
+                    lookahead_warm_directory(c->args.ptr[k]);
+            }
+        }
+    }
+
+    dstr_term(&resolved);
+}
+
+// runs on the helper thread, which owns the slot until it is published
+static void lookahead_prepare(lookahead_t* this_p, lookahead_slot_t* slot)
+{
+    arena_reset(&slot->arena);
+    slot->text = "";
+    slot->len = 0;
+    slot->program = 0;
+    slot->is_eof = false;
+    slot->read_errno = 0;
+    slot->is_barrier = false;
+
+    uint32_t cache_line = 0;
+    if (this_p->input)
+    {
+        read_input_state_t* input = this_p->input;
+        errno = 0;
+        if (!read_input_get_line(input))
+        {
+            slot->read_errno = errno ? errno : EIO;
+            return;
+        }
+
+        // a last line without '\n' is not run, as in run_interal()
+        if (input->is_eof)
+        {
+            slot->is_eof = true;
+            return;
+        }
+
+        // a line in the read buffer is overwritten by the next reads
+        if (input->is_mapped)
+            slot->text = input->line;
+        else if (dstr_assign_view(&slot->line, input->line, input->line_len))
+            slot->text = slot->line.ptr;
+        else
+        {
+            slot->read_errno = ENOMEM;
+            return;
+        }
+
+        slot->len = input->line_len;
+    }
+    else
+    {
+        if (this_p->cache_line >= this_p->cache->line_count)
+        {
+            slot->is_eof = true;
+            return;
+        }
+
+        cache_line = this_p->cache_line++;
+        slot->text = script_cache_line_text(this_p->cache, cache_line, &slot->len);
+    }
+
+    if (slot->text[0] == '\n')
+        return;
+
+    slot->program = this_p->input
+        ? parse_command_line_quiet(slot->text, &slot->arena)
+        : script_cache_line_program(this_p->cache, cache_line, &slot->arena);
+
+    if (slot->program)
+        slot->is_barrier = lookahead_is_barrier(slot->program);
+}
+
+static void* lookahead_thread(void* arg)
+{
+    lookahead_t* this_p = arg;
+
+    pthread_mutex_lock(&this_p->lock);
+    while (!this_p->is_stopping)
+    {
+        long const ahead = this_p->produced - this_p->consumed;
+        lookahead_slot_t const* last = ahead ? &this_p->slots[(this_p->produced - 1) % this_p->depth] : 0;
+        if (ahead >= this_p->depth || (last && last->is_barrier))
+        {
+            pthread_cond_wait(&this_p->cond, &this_p->lock);
+            continue;
+        }
+
+        lookahead_slot_t* slot = &this_p->slots[this_p->produced % this_p->depth];
+        pthread_mutex_unlock(&this_p->lock);
+
+        lookahead_prepare(this_p, slot);
+        if (slot->program)
+            lookahead_warm(slot->program);
+
+        pthread_mutex_lock(&this_p->lock);
+        ++this_p->produced;
+        ++lookahead_stats.prepared;
+        lookahead_stats.barriers += slot->is_barrier;
+        pthread_cond_broadcast(&this_p->cond);
+
+        // the run stops at a line that cannot be read or parsed
+        if (slot->is_eof || slot->read_errno || (!slot->program && slot->text[0] != '\n'))
+            break;
+    }
+    pthread_mutex_unlock(&this_p->lock);
+
+    return 0;
+}
+
+static void lookahead_slots_term(lookahead_t* this_p)
+{
+    pthread_cond_destroy(&this_p->cond);
+    pthread_mutex_destroy(&this_p->lock);
+
+    for (int i = 0; i < this_p->depth; ++i)
+    {
+        arena_term(&this_p->slots[i].arena);
+        dstr_term(&this_p->slots[i].line);
+    }
+
+    free(this_p->slots);
+    this_p->slots = 0;
+}
+
+bool lookahead_init(lookahead_t* this_p, int depth, read_input_state_t* input, script_cache_t const* cache)
+{
+    this_p->slots = malloc(depth * sizeof(lookahead_slot_t));
+    if (!this_p->slots)
+    {
+        fprintf(stderr,"No enough memory.\n");
+        return false;
+    }
+
+    for (int i = 0; i < depth; ++i)
+    {
+        arena_init(&this_p->slots[i].arena);
+        dstr_init(&this_p->slots[i].line);
+    }
+
+    this_p->depth = depth;
+    this_p->produced = 0;
+    this_p->consumed = 0;
+    this_p->is_stopping = false;
+    this_p->input = input;
+    this_p->cache = cache;
+    this_p->cache_line = 0;
+
+    pthread_mutex_init(&this_p->lock, 0);
+    pthread_cond_init(&this_p->cond, 0);
+
+    int err = pthread_create(&this_p->thread, 0, lookahead_thread, this_p);
+    if (err)
+    {
+        fprintf(stderr, "error: lookahead thread: %s\n", strerror(err));
+        lookahead_slots_term(this_p);
+        return false;
+    }
+
+    return true;
+}
+
+void lookahead_term(lookahead_t* this_p)
+{
+    pthread_mutex_lock(&this_p->lock);
+    this_p->is_stopping = true;
+    pthread_cond_broadcast(&this_p->cond);
+    pthread_mutex_unlock(&this_p->lock);
+    pthread_join(this_p->thread, 0);
+
+    lookahead_slots_term(this_p);
+}
+
+lookahead_slot_t* lookahead_next(lookahead_t* this_p)
+{
+    pthread_mutex_lock(&this_p->lock);
+    if (this_p->produced > this_p->consumed)
+        ++lookahead_stats.ready;
+
+    while (this_p->produced == this_p->consumed)
+        pthread_cond_wait(&this_p->cond, &this_p->lock);
+
+    lookahead_slot_t* slot = &this_p->slots[this_p->consumed % this_p->depth];
+    pthread_mutex_unlock(&this_p->lock);
+    return slot;
+}
+
+void lookahead_release(lookahead_t* this_p)
+{
+    pthread_mutex_lock(&this_p->lock);
+    ++this_p->consumed;
+    pthread_cond_broadcast(&this_p->cond);
+    pthread_mutex_unlock(&this_p->lock);
+}
+
+void lookahead_stats_print(void)
+{
+    fprintf(stderr, "lookahead     : %ld lines prepared, %ld ready when needed, %ld barriers, %ld executables resolved, %ld directories read\n",
+        lookahead_stats.prepared, lookahead_stats.ready, lookahead_stats.barriers, lookahead_stats.resolved, lookahead_stats.directories);
+}
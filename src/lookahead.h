@@ -0,0 +1,74 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/arena.h"
+#include "base/bool.h"
+#include "base/dstr.h"
+#include "base/read.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct program_s program_t;
+typedef struct script_cache_s script_cache_t;
+
+// prepares the next lines of a batch script on a helper thread while the shell waits
+// for the commands of the current one: the lines are read and parsed, or built from the
+// script cache, into slots of their own arenas, and what they will need is warmed up:
+// the executables of bare names are resolved into the path cache and the directories
+// of the wildcards are read, so they are in the kernel caches when the line expands;
+// the executables and the input redirections are prefetched into the page cache
+// nothing prepared decides the outcome of a line, the resolutions and expansions are
+// made again when the line runs; still, after a line with a 'cd' or an output
+// redirection the helper prepares nothing until that line ran, the directories it would
+// read could be other ones, or have other entries
+
+#define lookahead_DEPTH_DEFAULT 4
+#define lookahead_DEPTH_MAX 64
+
+typedef struct lookahead_slot_s
+{
+    arena_t arena;          // everything of the line, released when the slot is reused
+    dstr_t line;            // lines of a read buffer; others are views into the mapped script or the cache
+    char const* text;       // the line, its '\n' included
+    size_t len;
+    program_t* program;     // 0 for a blank line or a line that does not parse
+    bool is_eof;
+    int read_errno;         // the error of a failed read, the slot is then the last one
+    bool is_barrier;        // has a 'cd' or an output redirection
+}
+lookahead_slot_t;
+
+typedef struct lookahead_s
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    lookahead_slot_t* slots;
+    int depth;
+    long produced;          // lines prepared by the helper
+    long consumed;          // lines released by the shell
+    bool is_stopping;
+
+    // the script, one of them
+    read_input_state_t* input;
+    script_cache_t const* cache;
+    uint32_t cache_line;
+}
+lookahead_t;
+
+// up to 'depth' lines are prepared ahead of the one that runs; one of 'input' and
+// 'cache' is given
+bool lookahead_init(lookahead_t* this_p, int depth, read_input_state_t* input, script_cache_t const* cache);
+void lookahead_term(lookahead_t* this_p);
+
+// returns the next line, waiting for the helper if it is not prepared yet; the slot is
+// the caller's until lookahead_release()
+lookahead_slot_t* lookahead_next(lookahead_t* this_p);
+void lookahead_release(lookahead_t* this_p);
+
+void lookahead_stats_print(void);
@@ -6,23 +6,280 @@
 
 #include "parser.h"
 #include "command.h"
+#include "program.h"
+#include "pathcache.h"
+#include "dircache.h"
+#include "dirscan.h"
+#include "glob.h"
+#include "scriptcache.h"
+#include "optimizer.h"
+#include "lookahead.h"
+#include "prefetch.h"
+#include "results.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <time.h>
 
 
 bool run(char const* file, int* exit_code);
+bool run_command(char const* command, int* exit_code);
+
+typedef struct mysh_options_s
+{
+    bool stats; // print execution statistics to stderr on exit
+    bool plan;  // print the program of every command line to stderr before running it
+    int lookahead; // lines of a script prepared ahead of the one that runs, 0 for none
+    char const* command; // the lines given with -c, run instead of a script
+    glob_limits_t glob_limits;
+}
+mysh_options_t;
+
+static mysh_options_t options = { .stats = false, .plan = false, .lookahead = 0, .command = 0 };
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mysh [--launcher=spawn|fork] [--dir-cache[=BYTES[K|M|G]]] [--batch-args[=JOBS]]\n"
+                    "            [--glob-max-entries=N] [--glob-max-results=N] [--glob-max-depth=N] [--glob-timeout=MS]\n"
+                    "            [--no-script-cache] [--lookahead[=LINES]] [--plan] [--results-fd=N] [--stats]\n"
+                    "            [-c command | file ...]\n");
+}
+
+// parses a size such as '4096', '512K' or '16M'
+static bool parse_size(char const* str, size_t* size)
+{
+    char* end;
+    errno = 0;
+    unsigned long long v = strtoull(str, &end, 10);
+    if (errno || end == str)
+        return false;
+
+    switch (*end)
+    {
+        case 'G': v *= 1024; // fall through
+        case 'M': v *= 1024; // fall through
+        case 'K': v *= 1024; ++end; break;
+        default: break;
+    }
+
+    if (*end)
+        return false;
+
+    *size = (size_t)v;
+    return true;
+}
+
+// parses the value of a '--name=N' limit option, 'value' points after the '='
+static bool parse_limit(char const* name, char const* value, long* limit)
+{
+    char* end;
+    errno = 0;
+    long v = strtol(value, &end, 10);
+    if (errno || end == value || *end || v < 0)
+    {
+        fprintf(stderr, "error: invalid value of %s '%s'\n", name, value);
+        return false;
+    }
+
+    *limit = v;
+    return true;
+}
+
+// returns the index of the first non-option argument, or -1 on an invalid option
+static int parse_options(int argc, char **argv)
+{
+    int i = 1;
+    for (; i < argc; ++i)
+    {
+        char const* a = argv[i];
+        if (strcmp(a, "-c") == 0)
+        {
+            if (i + 1 == argc)
+            {
+                fprintf(stderr, "error: -c needs a command\n");
+                return -1;
+            }
+
+            options.command = argv[++i];
+            continue;
+        }
+
+        if (strncmp(a, "--", 2) != 0)
+            break;
+
+        if (strcmp(a, "--") == 0)
+            return i + 1;
+
+        if (strncmp(a, "--launcher=", 11) == 0)
+        {
+            if (!command_launcher_set_by_name(a + 11))
+            {
+                fprintf(stderr, "error: unknown launcher '%s'\n", a + 11);
+                return -1;
+            }
+        }
+        else if (strcmp(a, "--dir-cache") == 0 || strncmp(a, "--dir-cache=", 12) == 0)
+        {
+            size_t budget = dir_cache_BUDGET_DEFAULT;
+            if (a[11] == '=' && !parse_size(a + 12, &budget))
+            {
+                fprintf(stderr, "error: invalid directory cache size '%s'\n", a + 12);
+                return -1;
+            }
+
+            if (!dir_cache_enable(budget))
+                return -1;
+        }
+        else if (strcmp(a, "--batch-args") == 0 || strncmp(a, "--batch-args=", 13) == 0)
+        {
+            int jobs = 1;
+            if (a[12] == '=')
+            {
+                char* end;
+                jobs = (int)strtol(a + 13, &end, 10);
+                if (end == a + 13 || *end || jobs < 1)
+                {
+                    fprintf(stderr, "error: invalid number of batch jobs '%s'\n", a + 13);
+                    return -1;
+                }
+            }
+
+            command_batch_set(jobs);
+        }
+        else if (strncmp(a, "--glob-max-entries=", 19) == 0)
+        {
+            if (!parse_limit("--glob-max-entries", a + 19, &options.glob_limits.max_entries))
+                return -1;
+        }
+        else if (strncmp(a, "--glob-max-results=", 19) == 0)
+        {
+            if (!parse_limit("--glob-max-results", a + 19, &options.glob_limits.max_results))
+                return -1;
+        }
+        else if (strncmp(a, "--glob-max-depth=", 17) == 0)
+        {
+            long depth;
+            if (!parse_limit("--glob-max-depth", a + 17, &depth))
+                return -1;
+            options.glob_limits.max_depth = depth > INT_MAX ? INT_MAX : (int)depth;
+        }
+        else if (strncmp(a, "--glob-timeout=", 15) == 0)
+        {
+            if (!parse_limit("--glob-timeout", a + 15, &options.glob_limits.timeout_ms))
+                return -1;
+        }
+        else if (strcmp(a, "--no-script-cache") == 0)
+        {
+            script_cache_enable(false);
+        }
+        else if (strcmp(a, "--lookahead") == 0 || strncmp(a, "--lookahead=", 12) == 0)
+        {
+            long lines = lookahead_DEPTH_DEFAULT;
+            if (a[11] == '=' && !parse_limit("--lookahead", a + 12, &lines))
+                return -1;
+            options.lookahead = lines > lookahead_DEPTH_MAX ? lookahead_DEPTH_MAX : (int)lines;
+        }
+        else if (strncmp(a, "--results-fd=", 13) == 0)
+        {
+            long fd;
+            if (!parse_limit("--results-fd", a + 13, &fd) || fd > INT_MAX || !results_open((int)fd))
+                return -1;
+        }
+        else if (strcmp(a, "--plan") == 0)
+        {
+            options.plan = true;
+        }
+        else if (strcmp(a, "--stats") == 0)
+        {
+            options.stats = true;
+        }
+        else
+        {
+            fprintf(stderr, "error: unknown option '%s'\n", a);
+            return -1;
+        }
+    }
+
+    return i;
+}
+
+static void stats_print(void)
+{
+    command_launcher_stats_print();
+    path_cache_stats_print();
+    dir_cache_stats_print();
+    dir_scan_stats_print();
+    glob_stats_print();
+    script_cache_stats_print();
+    optimizer_stats_print();
+    lookahead_stats_print();
+    prefetch_stats_print();
+}
+
+// rewrites a parsed command line, then prints it with --plan
+static void plan(program_t* program)
+{
+    optimizer_run(program);
+
+    if (options.plan)
+    {
+        fflush(stdout);
+        program_print(program, stderr);
+    }
+}
+
+static long long clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// runs a compiled command line, whose outcome is reported with --results-fd
+static bool execute(program_t* program, long line, command_exec_status_t* exec_status)
+{
+    if (!results_is_enabled())
+        return program_exec(program, exec_status);
+
+    long long start_ns = clock_ns();
+    bool result = program_exec(program, exec_status);
+    results_line(line, program, result, exec_status, clock_ns() - start_ns);
+    return result;
+}
 
 int main(int argc, char **argv)
 {
     int exit_code = EXIT_SUCCESS;
 
-    if (argc > 1)
+    int first = parse_options(argc, argv);
+    if (first < 0)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (options.command && argc > first)
+    {
+        fprintf(stderr, "error: -c runs no script\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    glob_limits_set(&options.glob_limits);
+
+    if (options.command)
+    {
+        int ec = EXIT_FAILURE;
+        if (!run_command(options.command, &ec))
+            exit_code = ec;
+    }
+    else if (argc > first)
     {
-        for(int i = 1; i < argc; i++)
+        for(int i = first; i < argc; i++)
         {
             int ec;
             if (!run(argv[i], &ec))
@@ -34,117 +291,319 @@ int main(int argc, char **argv)
     }
     else
     {
-        int ec;
+        // a terminal sets no exit code, a streamed script does as a file
+        int ec = EXIT_FAILURE;
         if (!run(0, &ec))
-            exit_code = EXIT_FAILURE;
+            exit_code = ec;
     }
 
+    if (options.stats)
+        stats_print();
+
+    results_close();
+    path_cache_term();
+    dir_cache_term();
+
     return exit_code;
 }
 
-bool run_interal_managed(read_input_state_t* input, int* exit_code)
+// where run_lines() takes the lines of a script or of a terminal from
+typedef struct line_source_s line_source_t;
+
+struct line_source_s
 {
-    if (input->is_interactive)
+    // reads the next line into 'text' and 'len' and compiles it into 'program', which is 0
+    // for a line that is not valid; sets 'is_eof' after the last line and returns false
+    // when the line cannot be read
+    bool (*next)(line_source_t* this_p, arena_t* arena);
+
+    // called once a line has run, before the next one is read; 0 when there is nothing to do
+    void (*release)(line_source_t* this_p);
+
+    void* context;
+    bool is_interactive;    // prompts for every line and goes on after a line that failed
+    bool is_echoed;         // prints every line after a 'mysh> ' prompt before it runs
+
+    bool is_eof;
+    char const* text;
+    size_t len;
+    program_t* program;
+};
+
+// runs one line of a script; returns false when the run stops there, with the exit
+// code of the shell in 'exit_code'
+static bool run_line(line_source_t const* source, long line, bool* result, int* exit_code)
+{
+    program_t* program = source->program;
+    if (!program)
+    {
+        *result = false;
+        results_line_error(line, "syntax error");
+
+        if (source->is_interactive)
+            return true;
+
+        *exit_code = -1;
+        return false;
+    }
+
+    // picks up changes of $PATH and of its directories once per command line
+    path_cache_revalidate();
+
+    plan(program);
+
+    command_exec_status_t exec_status = { .code = 0, .exit = false };
+    *result = execute(program, line, &exec_status);
+
+    // the code of 'exit' is its argument, that of a command is its wait() status
+    if (exec_status.exit)
+    {
+        *exit_code = exec_status.code;
+        return false;
+    }
+
+    if (!*result)
+    {
+        if (source->is_interactive)
+            return true;
+
+        *exit_code = -1;
+        return false;
+    }
+
+    int status = command_status_code(exec_status.code);
+    *result = status == 0;
+    if (*result || source->is_interactive)
+        return true;
+
+    *exit_code = status;
+    return false;
+}
+
+// runs the lines of 'source' one after the other; returns false if the run ended with
+// a line that failed, with the exit code of the shell in 'exit_code'
+static bool run_lines(line_source_t* source, arena_t* arena, int* exit_code)
+{
+    if (source->is_interactive)
         printf("Welcome to my shell!\n");
 
     bool result = true;
+    long line = 0;
     while (1)
     {
-        if(input->is_interactive)
-        {
-            if(result)
-                printf("mysh> ");
-            else
-                printf("!mysh> ");
+        arena_reset(arena);
 
+        if (source->is_interactive)
+        {
+            printf(result ? "mysh> " : "!mysh> ");
             fflush(stdout);
         }
 
-        if (!read_input_get_line(input))
+        if (!source->next(source, arena))
         {
             perror("getline");
-            result = false;
-            break;
+            *exit_code = -1;
+            return false;
         }
 
-        if(input->is_eof)
+        if (source->is_eof)
             break;
 
-        if(input->line.ptr[0] == '\n')
+        ++line;
+        bool is_going_on = true;
+        if (source->text[0] == '\n')
         {
-            if (!input->is_interactive)
-            {
+            if (source->is_echoed)
                 printf("\n");
-            }
-            continue;
         }
-
-        command_node_t* cmd = parse_command_line(input->line.ptr);
-
-        if (!input->is_interactive)
+        else
         {
-            printf("mysh> %s", input->line.ptr);
-        }
+            if (source->is_echoed)
+                printf("mysh> %.*s", (int)source->len, source->text);
 
-        if (cmd)
-        {
-            result = true;
+            is_going_on = run_line(source, line, &result, exit_code);
         }
-        else
-        {
-            result = false;
 
-            if (!input->is_interactive)
-            {
-                *exit_code = -1;
-                return false;
-            }
+        if (source->release)
+            source->release(source);
 
-            continue;
-        }
+        if (!is_going_on)
+            return *exit_code == 0;
+    }
 
-        command_exec_status_t exec_status = { .code = 0, .exit = false };
-        result = command_node_exec(cmd, &exec_status);
-        command_node_term(cmd);
+    return result;
+}
 
-        //printf("\n");
-        if (result)
-        {
-            if (exec_status.code != 0)
-            {
-                result = false;
-                if (!input->is_interactive)
-                {
-                    *exit_code = exec_status.code;
-                    return false;
-                }
-            }
-        }
-        else
-        {
-            if (!input->is_interactive)
-            {
-                *exit_code = -1;
-                return false;
-            }
-        }
-        
-        if (exec_status.exit)
-            break;
+static bool run_lines_managed(line_source_t* source, int* exit_code)
+{
+    // owns everything allocated for one command line, reset before the next one
+    arena_t arena;
+    arena_init(&arena);
+
+    bool result = run_lines(source, &arena, exit_code);
+
+    arena_term(&arena);
+    return result;
+}
+
+// the lines of a script or of a terminal, read as they are run
+static bool read_source_next(line_source_t* this_p, arena_t* arena)
+{
+    read_input_state_t* input = this_p->context;
+
+    // a driver streaming the script waits for the results of the lines it sent
+    if (input->fin == 0)
+        results_flush();
+
+    if (!read_input_get_line(input))
+        return false;
+
+    this_p->is_eof = input->is_eof;
+    this_p->text = input->line;
+    this_p->len = input->line_len;
+
+    // the line is a view into the input, the lexer stops at its '\n'
+    this_p->program = !this_p->is_eof && this_p->text[0] != '\n'
+        ? parse_command_line(this_p->text, arena)
+        : 0;
+    return true;
+}
+
+// the lines of a script from its cached programs
+typedef struct cached_source_s
+{
+    script_cache_t const* cache;
+    uint32_t line;
+}
+cached_source_t;
+
+static bool cached_source_next(line_source_t* this_p, arena_t* arena)
+{
+    cached_source_t* source = this_p->context;
+    if (source->line >= source->cache->line_count)
+    {
+        this_p->is_eof = true;
+        return true;
+    }
+
+    uint32_t const line = source->line++;
+    this_p->text = script_cache_line_text(source->cache, line, &this_p->len);
+    this_p->program = this_p->text[0] != '\n'
+        ? script_cache_line_program(source->cache, line, arena)
+        : 0;
+    return true;
+}
+
+// the lines of a -c command
+static bool command_source_next(line_source_t* this_p, arena_t* arena)
+{
+    char const** command = this_p->context;
+    char const* line = *command;
+    if (!*line)
+    {
+        this_p->is_eof = true;
+        return true;
     }
 
-    return result; 
+    char const* nl = strchr(line, '\n');
+    *command = nl ? nl + 1 : line + strlen(line);
+
+    // the lexer stops at the '\n' or at the end of the command
+    this_p->text = line;
+    this_p->len = *command - line;
+    this_p->program = line[0] != '\n' ? parse_command_line(line, arena) : 0;
+    return true;
+}
+
+// the lines of a script the helper prepared
+static bool lookahead_source_next(line_source_t* this_p, arena_t* arena)
+{
+    lookahead_t* lookahead = this_p->context;
+    lookahead_slot_t* slot = lookahead_next(lookahead);
+    if (slot->read_errno)
+    {
+        errno = slot->read_errno;
+        return false;
+    }
+
+    this_p->is_eof = slot->is_eof;
+    this_p->text = slot->text;
+    this_p->len = slot->len;
+    this_p->program = slot->program;
+
+    // parsed again to print the errors the helper kept quiet
+    if (!slot->program && !slot->is_eof && slot->text[0] != '\n' && lookahead->input)
+        parse_command_line(slot->text, arena);
+
+    return true;
+}
+
+static void lookahead_source_release(line_source_t* this_p)
+{
+    lookahead_release(this_p->context);
+}
+
+bool run_command(char const* command, int* exit_code)
+{
+    // run as a script is, without echoing the lines
+    line_source_t source = { .next = command_source_next, .context = &command };
+    return run_lines_managed(&source, exit_code);
+}
+
+static bool run_lookahead(read_input_state_t* input, script_cache_t const* cache, int* exit_code)
+{
+    lookahead_t lookahead;
+    if (!lookahead_init(&lookahead, options.lookahead, input, cache))
+    {
+        *exit_code = -1;
+        return false;
+    }
+
+    line_source_t source = { .next = lookahead_source_next, .release = lookahead_source_release,
+        .context = &lookahead, .is_echoed = true };
+    bool result = run_lines_managed(&source, exit_code);
+
+    lookahead_term(&lookahead);
+    return result;
 }
 
 bool run(char const* file, int* exit_code)
 {
+    script_cache_t cache;
+    if (file && script_cache_open(&cache, file))
+    {
+        bool res;
+        if (options.lookahead)
+            res = run_lookahead(0, &cache, exit_code);
+        else
+        {
+            cached_source_t cached = { .cache = &cache, .line = 0 };
+            line_source_t source = { .next = cached_source_next, .context = &cached, .is_echoed = true };
+            res = run_lines_managed(&source, exit_code);
+        }
+
+        script_cache_close(&cache);
+        return res;
+    }
+
     read_input_state_t state;
     read_input_init(&state);
 
     if (!read_input_open(&state, file))
+    {
+        *exit_code = -1;
         return false;
+    }
 
-    bool res = run_interal_managed(&state, exit_code);
+    bool res;
+    if (file && options.lookahead)
+        res = run_lookahead(&state, 0, exit_code);
+    else
+    {
+        line_source_t source = { .next = read_source_next, .context = &state,
+            .is_interactive = state.is_interactive, .is_echoed = !state.is_interactive };
+        res = run_lines_managed(&source, exit_code);
+    }
 
     read_input_term(&state);
     return res;
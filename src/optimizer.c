@@ -0,0 +1,103 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "optimizer.h"
+#include "program.h"
+#include "command.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct optimizer_stats_s
+{
+    long pipelines;     // rewritten
+    long cats;          // stages removed
+}
+optimizer_stats_t;
+
+static optimizer_stats_t optimizer_stats;
+
+// the file a leading 'cat f' or 'cat < f' copies to the pipe, 0 if the command is not
+// one of those or if 'cmd < f' could behave differently, e.g. print another error
+static char const* optimizer_cat_input(command_t const* c)
+{
+    if (c->command_type != COMMAND_EXTERNAL || strcmp(c->executable.ptr, "cat") != 0 || !dstr_is_null(&c->redir_out_to))
+        return 0;
+
+    char const* file = 0;
+    int arg_count = 0;
+    for (plst_len_t i = 1; i < c->args.len; ++i)
+    {
+        if (c->args.ptr[i])
+        {
+            file = c->args.ptr[i];
+            ++arg_count;
+        }
+    }
+
+    if (arg_count == 1 && dstr_is_null(&c->redir_in_from))
+    {
+        // an option, stdin or a pattern that may match several files
+        if (file[0] == '-' || strpbrk(file, "*?["))
+            return 0;
+    }
+    else if (arg_count == 0 && !dstr_is_null(&c->redir_in_from))
+        file = c->redir_in_from.ptr;
+    else
+        return 0;
+
+    struct stat st;
+    if (stat(file, &st) == -1 || !S_ISREG(st.st_mode) || access(file, R_OK) == -1)
+        return 0;
+
+    return file;
+}
+
+static void optimizer_pipeline(dlst_t* pipeline)
+{
+    bool is_rewritten = false;
+    while (pipeline->len >= 2)
+    {
+        command_t* first = dlst_at(pipeline, 0);
+        command_t* next = dlst_at(pipeline, 1);
+        if (next->command_type != COMMAND_EXTERNAL || !dstr_is_null(&next->redir_in_from))
+            break;
+
+        char const* file = optimizer_cat_input(first);
+        if (!file || !dstr_assign_str(&next->redir_in_from, file))
+            break;
+
+        memmove(first, next, (pipeline->len - 1) * sizeof(command_t));
+        --pipeline->len;
+
+        is_rewritten = true;
+        ++optimizer_stats.cats;
+    }
+
+    if (is_rewritten)
+        ++optimizer_stats.pipelines;
+}
+
+// only the first pipeline of a line runs right after the check of its file; a later
+// one could find it removed or changed by the commands before it, and 'cmd < f' would
+// then fail where 'cat f | cmd' succeeds
+void optimizer_run(program_t* program)
+{
+    for (dlst_len_t i = 0; i < program->code.len; ++i)
+    {
+        program_instr_t* instr = dlst_at(&program->code, i);
+        if (instr->op == PROGRAM_OP_PIPELINE)
+        {
+            optimizer_pipeline(&instr->pipeline);
+            break;
+        }
+    }
+}
+
+void optimizer_stats_print(void)
+{
+    fprintf(stderr, "optimizer     : %ld pipelines rewritten, %ld cat stages removed\n",
+        optimizer_stats.pipelines, optimizer_stats.cats);
+}
@@ -0,0 +1,21 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+
+typedef struct program_s program_t;
+
+// rewrites of a compiled command line that leave what it prints unchanged, applied
+// between its parsing and its run
+// - 'cat f | cmd' becomes 'cmd < f'
+// - 'cat < f | cmd' becomes 'cmd < f'
+// repeatedly, so 'cat f | cat | cmd' is 'cmd < f'; 'f' must be a readable regular file
+// when the line is compiled, with no wildcard, and 'cmd' an external command without
+// an input redirection; only the first pipeline of a line is rewritten, the commands
+// that run before a later one could remove or change 'f'
+
+void optimizer_run(program_t* program);
+
+void optimizer_stats_print(void);
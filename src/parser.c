@@ -8,6 +8,7 @@
 #include "lexer.h"
 #include "base/bool.h"
 #include "command.h"
+#include "program.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +21,7 @@
 
 static inline void get(parser_t* this_p);
 static inline bool expect(parser_t* this_p, token_type_t tt);
+static inline void word(parser_t* this_p);
 static void        syntax_error_state(parser_t* this_p, error_type_t et);
 static void        syntax_error_token_expected(parser_t* this_p, token_type_t tt);
 //static inline bool start_of(parser_t* this_p, parser_state_t pt);
@@ -46,6 +48,13 @@ static inline bool expect(parser_t* this_p, token_type_t tt)
 	return true;
 }
 
+// 'hash' is a builtin as the command, as an argument or a redirection it is a PATH
+static inline void word(parser_t* this_p)
+{
+	if (this_p->la->token_type == TOKEN_COMMAND_HASH)
+		this_p->la->token_type = TOKEN_PATH;
+}
+
 static bool parser(parser_t* this_p);
 static bool command_pipeline(parser_t* this_p, dlst_t* pipeline);
 static bool redirected_command(parser_t* this_p, command_t* cmd);
@@ -57,15 +66,12 @@ static bool command_redir(parser_t* this_p, dstr_t* redir_in_from, dstr_t* redir
 
 static bool parser(parser_t* this_p)
 {
-	command_node_t* n;
 	dlst_t pipeline;
-	dlst_init(&pipeline, sizeof(command_t));
+	dlst_init_arena(&pipeline, sizeof(command_t), this_p->arena);
 	if (!command_pipeline(this_p, &pipeline))
 		return false;
-	n = command_node_compose_single(&pipeline);
-	if (!n)
-	return false;
-	this_p->cmd_root_node = n;
+	if (!program_emit_pipeline(this_p->program, &pipeline))
+		return false;
 	while (this_p->la->token_type == TOKEN_AND || this_p->la->token_type == TOKEN_OR)
 	{
 		command_combine_type_t command_combine_type = COMMAND_COMBINE_NONE;
@@ -79,22 +85,23 @@ static bool parser(parser_t* this_p)
 			get(this_p);
 			command_combine_type = COMMAND_COMBINE_AND;
 		}
-		dlst_init(&pipeline, sizeof(command_t));
+		if (!program_emit_combine(this_p->program, command_combine_type))
+			return false;
+		dlst_init_arena(&pipeline, sizeof(command_t), this_p->arena);
 		if (!command_pipeline(this_p, &pipeline))
 			return false;
-		n = command_node_compose_binary(command_combine_type, this_p->cmd_root_node, &pipeline);
-		if (!n)
-		return false;
-		this_p->cmd_root_node = n;
+		if (!program_emit_pipeline(this_p->program, &pipeline))
+			return false;
 	}
 
+	program_link(this_p->program);
 	return true;
 }
 
 static bool command_pipeline(parser_t* this_p, dlst_t* pipeline)
 {
 	command_t cmd;
-	command_init(&cmd);
+	command_init(&cmd, this_p->arena);
 	if (!redirected_command(this_p, &cmd))
 		return false;
 	if (!dlst_append(pipeline, &cmd))
@@ -102,7 +109,7 @@ static bool command_pipeline(parser_t* this_p, dlst_t* pipeline)
 	while (this_p->la->token_type == TOKEN_PIPE)
 	{
 		get(this_p);
-		command_init(&cmd);
+		command_init(&cmd, this_p->arena);
 		if (!redirected_command(this_p, &cmd))
 			return false;
 		if (!dlst_append(pipeline, &cmd))
@@ -116,6 +123,7 @@ static bool redirected_command(parser_t* this_p, command_t* cmd)
 {
 	if (!command(this_p, cmd))
 		return false;
+	word(this_p);
 	if (this_p->la->token_type == TOKEN_PATH)
 	{
 		if (!command_args(this_p, &cmd->args))
@@ -136,10 +144,10 @@ static bool command(parser_t* this_p, command_t* cmd)
 	{
 		get(this_p);
 		cmd->command_type = COMMAND_EXTERNAL;
-		if (!dstr_assign_dstr(&cmd->executable, &this_p->t->token_text))
+		if (!dstr_assign_view(&cmd->executable, this_p->t->ptr, this_p->t->len))
 		return false;
 
-		char* arg0 = command_arg_compose(&this_p->t->token_text);
+		char* arg0 = command_arg_compose(this_p->arena, this_p->t);
 		if (!arg0)
 		return false;
 		if (!plst_append(&cmd->args, arg0))
@@ -149,21 +157,28 @@ static bool command(parser_t* this_p, command_t* cmd)
 	{
 		get(this_p);
 		cmd->command_type = COMMAND_BUILTIN_CD;
-		if (!dstr_assign_dstr(&cmd->executable, &this_p->t->token_text))
+		if (!dstr_assign_view(&cmd->executable, this_p->t->ptr, this_p->t->len))
 		return false;
 	}
 	else if (this_p->la->token_type == TOKEN_COMMAND_PWD)
 	{
 		get(this_p);
 		cmd->command_type = COMMAND_BUILTIN_PWD;
-		if (!dstr_assign_dstr(&cmd->executable, &this_p->t->token_text))
+		if (!dstr_assign_view(&cmd->executable, this_p->t->ptr, this_p->t->len))
 		return false;
 	}
 	else if (this_p->la->token_type == TOKEN_COMMAND_EXIT)
 	{
 		get(this_p);
 		cmd->command_type = COMMAND_BUILTIN_EXIT;
-		if (!dstr_assign_dstr(&cmd->executable, &this_p->t->token_text))
+		if (!dstr_assign_view(&cmd->executable, this_p->t->ptr, this_p->t->len))
+		return false;
+	}
+	else if (this_p->la->token_type == TOKEN_COMMAND_HASH)
+	{
+		get(this_p);
+		cmd->command_type = COMMAND_BUILTIN_HASH;
+		if (!dstr_assign_view(&cmd->executable, this_p->t->ptr, this_p->t->len))
 		return false;
 	}
 	else
@@ -180,21 +195,23 @@ static bool command_args(parser_t* this_p, plst_t* args)
 	char* p;
 	if (!expect(this_p, TOKEN_PATH))
 		return false;
-	p = command_arg_compose(&this_p->t->token_text);
+	p = command_arg_compose(this_p->arena, this_p->t);
 	if (!p)
 	return false;
 
 	if (!plst_append(args, p))
 	return false;
+	word(this_p);
 	while (this_p->la->token_type == TOKEN_PATH)
 	{
 		get(this_p);
-		p = command_arg_compose(&this_p->t->token_text);
+		p = command_arg_compose(this_p->arena, this_p->t);
 		if (!p)
 		return false;
 
 		if (!plst_append(args, p))
 		return false;
+		word(this_p);
 	}
 	if (!plst_append_zero(args))
 	return false;
@@ -220,27 +237,31 @@ static bool command_redir(parser_t* this_p, dstr_t* redir_in_from, dstr_t* redir
 	if (this_p->la->token_type == TOKEN_REDIRECTION_IN)
 	{
 		get(this_p);
+		word(this_p);
 		if (!expect(this_p, TOKEN_PATH))
 			return false;
 		if (!dstr_is_null(redir_in_from))
 		{
-		fprintf(stderr, "error: excessive in-redirection '%s'\n", this_p->t->token_text.ptr);
+		if (!this_p->is_quiet)
+			fprintf(stderr, "error: excessive in-redirection '%.*s'\n", this_p->t->len, this_p->t->ptr);
 		return false;
 		}
-		if (!dstr_assign_dstr(redir_in_from, &this_p->t->token_text))
+		if (!dstr_assign_view(redir_in_from, this_p->t->ptr, this_p->t->len))
 		return false;
 	}
 	else if (this_p->la->token_type == TOKEN_REDIRECTION_OUT)
 	{
 		get(this_p);
+		word(this_p);
 		if (!expect(this_p, TOKEN_PATH))
 			return false;
 		if (!dstr_is_null(redir_out_to))
 		{
-		fprintf(stderr, "error: excessive out-redirection '%s'\n", this_p->t->token_text.ptr);
+		if (!this_p->is_quiet)
+			fprintf(stderr, "error: excessive out-redirection '%.*s'\n", this_p->t->len, this_p->t->ptr);
 		return false;
 		}
-		if (!dstr_assign_dstr(redir_out_to, &this_p->t->token_text))
+		if (!dstr_assign_view(redir_out_to, this_p->t->ptr, this_p->t->len))
 		return false;
 	}
 	else
@@ -254,18 +275,24 @@ static bool command_redir(parser_t* this_p, dstr_t* redir_in_from, dstr_t* redir
 
 
 
-command_node_t* parse_command_line(char const* command_line)
+static program_t* parse_command_line_internal(char const* command_line, arena_t* arena, bool is_quiet)
 {
 	parser_t p;
 	parser_t* this_p = &p;
 
+	this_p->program = arena_alloc(arena, sizeof(program_t));
+	if (!this_p->program)
+		return 0;
+	program_init(this_p->program, arena);
+
 	token_t tokens[2];
-	token_init(&tokens[0]);
-	token_init(&tokens[1]);
+	token_init_arena(&tokens[0], arena);
+	token_init_arena(&tokens[1], arena);
 	this_p->pos = this_p->str = command_line;
 	this_p->t = tokens + 0;
 	this_p->la = tokens + 1;
-	this_p->cmd_root_node = 0;
+	this_p->arena = arena;
+	this_p->is_quiet = is_quiet;
 
 	get(this_p);
 
@@ -284,25 +311,30 @@ command_node_t* parse_command_line(char const* command_line)
 	token_term(&tokens[1]);
 
 	if (!result)
-	{
-		if (this_p->cmd_root_node)
-		{
-			command_node_term(this_p->cmd_root_node);
-			this_p->cmd_root_node = 0;
-		}
 		return 0;
-	}
 	
-	return this_p->cmd_root_node;
+	return this_p->program;
+}
+
+program_t* parse_command_line(char const* command_line, arena_t* arena)
+{
+	return parse_command_line_internal(command_line, arena, false);
+}
+
+program_t* parse_command_line_quiet(char const* command_line, arena_t* arena)
+{
+	return parse_command_line_internal(command_line, arena, true);
 }
 
 static void syntax_error_state(parser_t* this_p, error_type_t et)
 {
-	printf("Syntax error: %d\n", et);
+	if (!this_p->is_quiet)
+		printf("Syntax error: %d\n", et);
 }
 
 static void syntax_error_token_expected(parser_t* this_p, token_type_t tt)
 {
-	printf("Error: expected token %d\n", tt);
+	if (!this_p->is_quiet)
+		printf("Error: expected token %d\n", tt);
 }
 
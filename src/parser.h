@@ -3,8 +3,10 @@
 
 #pragma once
 #include "token.h"
+#include "base/arena.h"
+#include "base/bool.h"
 
-typedef struct command_node_s command_node_t;
+typedef struct program_s program_t;
 
 typedef struct parser_s
 {
@@ -14,10 +16,17 @@ typedef struct parser_s
 	token_t* t;     // last recognized token
 	token_t* la;    // lookahead token
 
-	command_node_t* cmd_root_node;
+	program_t* program; // the command line compiled so far
+	arena_t* arena; // owns all memory of the parsed command line
+	bool is_quiet;  // no error messages
 
 }
 parser_t;
 
-command_node_t* parse_command_line(char const* command_line);
+// the command line is compiled as it is parsed, the returned program lives in 'arena',
+// on failure the arena may hold partial results; in both cases it is released by
+// resetting the arena
+program_t* parse_command_line(char const* command_line, arena_t* arena);
+// as parse_command_line(), without printing the errors of an invalid command line
+program_t* parse_command_line_quiet(char const* command_line, arena_t* arena);
 
@@ -17,10 +17,11 @@ typedef enum token_type_e
 	TOKEN_REDIRECTION_OUT=8,
 	TOKEN_PIPE=9,
 	TOKEN_AND=10,
-	TOKEN_OR=11
+	TOKEN_OR=11,
+	TOKEN_COMMAND_HASH=12
 }
 token_type_t;
 
-unsigned int static const maxT = 12;
+unsigned int static const maxT = 13;
 
 
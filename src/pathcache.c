@@ -0,0 +1,439 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "pathcache.h"
+#include "base/dstr.h"
+#include "base/dlst.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if (_MSC_VER >= 1400)
+#pragma warning(disable: 4996) // disabling deprecation for msvc
+#endif
+
+// used when $PATH is not set, the directories the shell used to probe
+#define PATH_CACHE_DEFAULT_PATH "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin"
+
+typedef struct path_cache_dir_s
+{
+    char* dname;
+    bool exists;
+    long long mtime_sec;
+    long mtime_nsec;
+}
+path_cache_dir_t;
+
+typedef struct path_cache_entry_s
+{
+    char* name;      // 0 for an empty slot
+    char* path;      // 0 for a name that was not found
+    unsigned hash;
+    int dir_index;   // PATH directory the name was found in, -1 when not found
+    int hits;
+}
+path_cache_entry_t;
+
+typedef struct path_cache_s
+{
+    char* path_env;             // value of $PATH the directories were split from
+    dlst_t dirs;                // path_cache_dir_t
+    int first_relative_dir;     // resolutions in relative directories depend on cwd
+    path_cache_entry_t* entries;
+    int cap;
+    int len;
+    long hits;
+    long misses;
+}
+path_cache_t;
+
+static path_cache_t cache = { 0 };
+
+// the lookahead of batch scripts resolves names on its own thread
+static pthread_mutex_t path_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned path_cache_hash(char const* name)
+{
+    // FNV-1a
+    unsigned h = 2166136261u;
+    for (; *name; ++name)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char* path_cache_strdup(char const* str)
+{
+    size_t l = strlen(str) + 1;
+    char* p = malloc(l);
+    if (!p)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return 0;
+    }
+
+    memcpy(p, str, l);
+    return p;
+}
+
+static void path_cache_entry_term(path_cache_entry_t* e)
+{
+    free(e->name);
+    free(e->path);
+    e->name = 0;
+    e->path = 0;
+}
+
+static void path_cache_dir_term(path_cache_dir_t* d)
+{
+    free(d->dname);
+    d->dname = 0;
+}
+
+static void path_cache_dir_stat(path_cache_dir_t* d)
+{
+    struct stat stat_struct;
+    if (stat(d->dname, &stat_struct) != 0 || !S_ISDIR(stat_struct.st_mode))
+    {
+        d->exists = false;
+        d->mtime_sec = 0;
+        d->mtime_nsec = 0;
+        return;
+    }
+
+    d->exists = true;
+    d->mtime_sec = stat_struct.st_mtim.tv_sec;
+    d->mtime_nsec = stat_struct.st_mtim.tv_nsec;
+}
+
+static bool path_cache_load_dirs(char const* path_env)
+{
+    free(cache.path_env);
+    dlst_term(&cache.dirs, (dlst_item_term_func_t)path_cache_dir_term);
+    dlst_init(&cache.dirs, sizeof(path_cache_dir_t));
+
+    cache.path_env = path_cache_strdup(path_env);
+    if (!cache.path_env)
+        return false;
+
+    cache.first_relative_dir = -1;
+
+    char const* cur = path_env;
+    while (true)
+    {
+        size_t l = strcspn(cur, ":");
+
+        path_cache_dir_t d;
+        if (l == 0)
+        {
+            // an empty entry stands for the current directory
+            d.dname = path_cache_strdup(".");
+        }
+        else
+        {
+            d.dname = malloc(l + 1);
+            if (d.dname)
+            {
+                memcpy(d.dname, cur, l);
+                d.dname[l] = 0;
+            }
+        }
+
+        if (!d.dname)
+            return false;
+
+        path_cache_dir_stat(&d);
+        if (!dlst_append(&cache.dirs, &d))
+        {
+            free(d.dname);
+            return false;
+        }
+
+        if (d.dname[0] != '/' && cache.first_relative_dir < 0)
+            cache.first_relative_dir = dlst_length(&cache.dirs) - 1;
+
+        if (!cur[l])
+            break;
+        cur += l + 1;
+    }
+
+    if (cache.first_relative_dir < 0)
+        cache.first_relative_dir = dlst_length(&cache.dirs);
+
+    return true;
+}
+
+static path_cache_entry_t* path_cache_find(char const* name, unsigned hash)
+{
+    if (!cache.cap)
+        return 0;
+
+    int mask = cache.cap - 1;
+    for (int i = hash & mask; cache.entries[i].name; i = (i + 1) & mask)
+    {
+        path_cache_entry_t* e = &cache.entries[i];
+        if (e->hash == hash && strcmp(e->name, name) == 0)
+            return e;
+    }
+
+    return 0;
+}
+
+static void path_cache_insert_entry(path_cache_entry_t* entries, int cap, path_cache_entry_t const* e)
+{
+    int mask = cap - 1;
+    int i = e->hash & mask;
+    while (entries[i].name)
+        i = (i + 1) & mask;
+
+    entries[i] = *e;
+}
+
+static bool path_cache_rehash(int cap)
+{
+    path_cache_entry_t* entries = calloc(cap, sizeof(path_cache_entry_t));
+    if (!entries)
+    {
+        fprintf(stderr, "No enough memory.\n");
+        return false;
+    }
+
+    for (int i = 0; i < cache.cap; ++i)
+    {
+        if (cache.entries[i].name)
+            path_cache_insert_entry(entries, cap, &cache.entries[i]);
+    }
+
+    free(cache.entries);
+    cache.entries = entries;
+    cache.cap = cap;
+    return true;
+}
+
+static void path_cache_insert(char const* name, unsigned hash, char const* path, int dir_index)
+{
+    // keep the load factor under 1/2
+    if ((cache.len + 1) * 2 > cache.cap)
+    {
+        if (!path_cache_rehash(cache.cap ? cache.cap * 2 : 64))
+            return;
+    }
+
+    path_cache_entry_t e;
+    e.name = path_cache_strdup(name);
+    e.path = path ? path_cache_strdup(path) : 0;
+    e.hash = hash;
+    e.dir_index = dir_index;
+    e.hits = 0;
+
+    if (!e.name || (path && !e.path))
+    {
+        path_cache_entry_term(&e);
+        return;
+    }
+
+    path_cache_insert_entry(cache.entries, cache.cap, &e);
+    ++cache.len;
+}
+
+// drops the entries a change of the directory 'dir_index' could affect: names found
+// in that directory or a later one, and names that were not found at all
+static void path_cache_drop_from(int dir_index)
+{
+    for (int i = 0; i < cache.cap; ++i)
+    {
+        path_cache_entry_t* e = &cache.entries[i];
+        if (e->name && (e->dir_index < 0 || e->dir_index >= dir_index))
+        {
+            path_cache_entry_term(e);
+            --cache.len;
+        }
+    }
+
+    // reinsert the survivors, linear probing does not allow holes in a probe sequence
+    path_cache_rehash(cache.cap);
+}
+
+static void path_cache_clear_internal(void);
+
+static void path_cache_revalidate_internal(void)
+{
+    char const* path_env = getenv("PATH");
+    if (!path_env)
+        path_env = PATH_CACHE_DEFAULT_PATH;
+
+    if (!cache.path_env || strcmp(cache.path_env, path_env) != 0)
+    {
+        path_cache_clear_internal();
+        path_cache_load_dirs(path_env);
+        return;
+    }
+
+    int first_changed = -1;
+    for (dlst_len_t i = 0; i < dlst_length(&cache.dirs); ++i)
+    {
+        path_cache_dir_t* d = dlst_at(&cache.dirs, i);
+        path_cache_dir_t old = *d;
+        path_cache_dir_stat(d);
+
+        if (old.exists != d->exists || old.mtime_sec != d->mtime_sec || old.mtime_nsec != d->mtime_nsec)
+        {
+            if (first_changed < 0)
+                first_changed = i;
+        }
+    }
+
+    if (first_changed >= 0 && cache.len)
+        path_cache_drop_from(first_changed);
+}
+
+static bool path_cache_lookup_internal(char const* name, dstr_t* resolved)
+{
+    if (!cache.path_env)
+        path_cache_revalidate_internal();
+
+    unsigned hash = path_cache_hash(name);
+    path_cache_entry_t* e = path_cache_find(name, hash);
+    if (e)
+    {
+        ++cache.hits;
+        ++(e->hits);
+        if (!e->path)
+            return false;
+
+        return dstr_assign_str(resolved, e->path);
+    }
+
+    ++cache.misses;
+
+    dstr_t path;
+    dstr_init(&path);
+
+    int dir_index = -1;
+    for (dlst_len_t i = 0; i < dlst_length(&cache.dirs); ++i)
+    {
+        path_cache_dir_t const* d = dlst_at(&cache.dirs, i);
+        if (!d->exists)
+            continue;
+
+        if (!dstr_assign_str(&path, d->dname) || !dstr_append_chr(&path, '/') || !dstr_append_str(&path, name))
+        {
+            dstr_term(&path);
+            return false;
+        }
+
+        struct stat stat_struct;
+        if (stat(path.ptr, &stat_struct) == 0
+            && S_ISREG(stat_struct.st_mode)
+            && (stat_struct.st_mode & (S_IXUSR|S_IXGRP|S_IXOTH)))
+        {
+            dir_index = i;
+            break;
+        }
+    }
+
+    // a relative PATH directory is resolved against cwd, which the cache does not track
+    bool cacheable = (dir_index < 0)
+        ? (cache.first_relative_dir >= dlst_length(&cache.dirs))
+        : (dir_index < cache.first_relative_dir);
+
+    if (cacheable)
+        path_cache_insert(name, hash, (dir_index < 0) ? 0 : path.ptr, dir_index);
+
+    if (dir_index < 0)
+    {
+        dstr_term(&path);
+        return false;
+    }
+
+    bool result = dstr_assign_dstr(resolved, &path);
+    dstr_term(&path);
+    return result;
+}
+
+static void path_cache_clear_internal(void)
+{
+    for (int i = 0; i < cache.cap; ++i)
+    {
+        if (cache.entries[i].name)
+            path_cache_entry_term(&cache.entries[i]);
+    }
+
+    cache.len = 0;
+}
+
+void path_cache_revalidate(void)
+{
+    pthread_mutex_lock(&path_cache_lock);
+    path_cache_revalidate_internal();
+    pthread_mutex_unlock(&path_cache_lock);
+}
+
+bool path_cache_lookup(char const* name, dstr_t* resolved)
+{
+    pthread_mutex_lock(&path_cache_lock);
+    bool result = path_cache_lookup_internal(name, resolved);
+    pthread_mutex_unlock(&path_cache_lock);
+    return result;
+}
+
+void path_cache_clear(void)
+{
+    pthread_mutex_lock(&path_cache_lock);
+    path_cache_clear_internal();
+    pthread_mutex_unlock(&path_cache_lock);
+}
+
+void path_cache_term(void)
+{
+    path_cache_clear_internal();
+    free(cache.entries);
+    cache.entries = 0;
+    cache.cap = 0;
+
+    dlst_term(&cache.dirs, (dlst_item_term_func_t)path_cache_dir_term);
+    free(cache.path_env);
+    cache.path_env = 0;
+}
+
+bool path_cache_print(dstr_t* out)
+{
+    char line[64];
+    pthread_mutex_lock(&path_cache_lock);
+
+    bool result = true;
+    if (cache.len)
+    {
+        result = dstr_append_str(out, "hits\tcommand\n");
+        for (int i = 0; result && i < cache.cap; ++i)
+        {
+            path_cache_entry_t const* e = &cache.entries[i];
+            if (!e->name)
+                continue;
+
+            snprintf(line, sizeof(line), "%4d\t", e->hits);
+            result = dstr_append_str(out, line)
+                  && (e->path ? dstr_append_str(out, e->path) : dstr_append_str(out, e->name) && dstr_append_str(out, ": not found"))
+                  && dstr_append_chr(out, '\n');
+        }
+    }
+
+    snprintf(line, sizeof(line), "hash: %d entries, %ld hits, %ld misses\n", cache.len, cache.hits, cache.misses);
+    result = result && dstr_append_str(out, line);
+
+    pthread_mutex_unlock(&path_cache_lock);
+    if (!result)
+        fprintf(stderr,"No enough memory.\n");
+    return result;
+}
+
+void path_cache_stats_print(void)
+{
+    fprintf(stderr, "path cache    : %d entries, %ld hits, %ld misses\n", cache.len, cache.hits, cache.misses);
+}
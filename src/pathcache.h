@@ -0,0 +1,21 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+#include "base/dstr.h"
+
+// resolution cache of bare command names over the directories of $PATH
+// both found and not found names are remembered; an entry is dropped when $PATH
+// changes or when the mtime of a PATH directory that could shadow it changes
+// lookup, revalidation and clearing may be called from several threads
+
+bool path_cache_lookup(char const* name, dstr_t* resolved);
+void path_cache_revalidate(void);
+void path_cache_clear(void);
+void path_cache_term(void);
+
+// appends the listing of the 'hash' builtin to 'out'
+bool path_cache_print(dstr_t* out);
+void path_cache_stats_print(void);
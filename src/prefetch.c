@@ -0,0 +1,127 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#if defined(__unix__) || defined(__CYGWIN__)
+	// enable mincore() when using glibc
+	#define _DEFAULT_SOURCE
+#endif
+
+#include "prefetch.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define prefetch_RECENT 32  // files remembered as requested
+
+typedef struct prefetch_stats_s
+{
+    long files;         // requested
+    long skipped;       // requested lately, not again
+    long pages;         // of the requested files
+    long cached;        // of those pages, already in the page cache
+}
+prefetch_stats_t;
+
+static prefetch_stats_t prefetch_stats;
+
+// hashes of the paths requested lately, a collision only loses a prefetch
+static uint64_t prefetch_recent[prefetch_RECENT];
+static unsigned prefetch_recent_next;
+
+static uint64_t prefetch_hash(char const* path)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (; *path; ++path)
+        h = (h ^ (unsigned char)*path) * 1099511628211ull;
+    return h ? h : 1;
+}
+
+static bool prefetch_is_recent(char const* path)
+{
+    uint64_t h = prefetch_hash(path);
+    for (unsigned i = 0; i < prefetch_RECENT; ++i)
+    {
+        if (prefetch_recent[i] == h)
+            return true;
+    }
+
+    prefetch_recent[prefetch_recent_next++ % prefetch_RECENT] = h;
+    return false;
+}
+
+// counts the pages of the first 'size' bytes of 'fd' the page cache holds
+static long prefetch_resident(int fd, size_t size, long page_size)
+{
+#if defined(__linux__)
+    void* map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return 0;
+
+    long resident = 0;
+    size_t pages = (size + page_size - 1) / page_size;
+    unsigned char vec[256];
+    for (size_t first = 0; first < pages; first += sizeof(vec))
+    {
+        size_t count = pages - first < sizeof(vec) ? pages - first : sizeof(vec);
+        if (mincore((char*)map + first * page_size, count * page_size, vec) == -1)
+            break;
+
+        for (size_t i = 0; i < count; ++i)
+            resident += vec[i] & 1;
+    }
+
+    munmap(map, size);
+    return resident;
+#else
+    (void)fd;
+    (void)size;
+    (void)page_size;
+    return 0;
+#endif
+}
+
+void prefetch_file(char const* path)
+{
+    if (prefetch_is_recent(path))
+    {
+        ++prefetch_stats.skipped;
+        return;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        size_t size = st.st_size < prefetch_BYTES_MAX ? (size_t)st.st_size : prefetch_BYTES_MAX;
+        long page_size = sysconf(_SC_PAGESIZE);
+        long pages = (long)((size + page_size - 1) / page_size);
+        long resident = prefetch_resident(fd, size, page_size);
+
+        // the kernel starts the reads and returns
+        if (resident < pages)
+            posix_fadvise(fd, 0, size, POSIX_FADV_WILLNEED);
+
+        ++prefetch_stats.files;
+        prefetch_stats.pages += pages;
+        prefetch_stats.cached += resident;
+    }
+
+    close(fd);
+}
+
+void prefetch_stats_print(void)
+{
+    fprintf(stderr, "prefetch      : %ld files, %ld skipped, %ld pages, %ld already cached (%.1f%% hit rate)\n",
+        prefetch_stats.files, prefetch_stats.skipped, prefetch_stats.pages, prefetch_stats.cached,
+        prefetch_stats.pages ? 100.0 * prefetch_stats.cached / prefetch_stats.pages : 0.0);
+}
@@ -0,0 +1,18 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+
+// asks the kernel to read a file into the page cache in the background, so a command
+// that runs a few lines later finds its executable and its input in memory instead of
+// faulting them in from the disk after the exec
+// only the first prefetch_BYTES_MAX bytes of a file are requested, and a file requested
+// lately is not requested again; not thread safe, one thread prefetches
+
+#define prefetch_BYTES_MAX (16 * 1024 * 1024)
+
+void prefetch_file(char const* path);
+
+void prefetch_stats_print(void);
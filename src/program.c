@@ -0,0 +1,150 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "program.h"
+
+#include <stdio.h>
+
+void program_init(program_t* this_p, arena_t* arena)
+{
+    dlst_init_arena(&(this_p->code), sizeof(program_instr_t), arena);
+}
+
+bool program_emit_pipeline(program_t* this_p, dlst_t const* pipeline)
+{
+    program_instr_t instr = { .op = PROGRAM_OP_PIPELINE, .pipeline = *pipeline };
+    return dlst_append(&(this_p->code), &instr);
+}
+
+bool program_emit_combine(program_t* this_p, command_combine_type_t combine_type)
+{
+    program_instr_t instr = { .target = 0 };
+    switch (combine_type)
+    {
+        case COMMAND_COMBINE_AND:
+            instr.op = PROGRAM_OP_JUMP_IF_FAILED;
+            break;
+        case COMMAND_COMBINE_OR:
+            instr.op = PROGRAM_OP_JUMP_IF_SUCCEEDED;
+            break;
+        default:
+            fprintf(stderr, "Unexpected error: invalid combine type '%d'\n", combine_type);
+            return false;
+    }
+
+    return dlst_append(&(this_p->code), &instr);
+}
+
+bool program_emit_jump(program_t* this_p, program_op_t op, dlst_len_t target)
+{
+    program_instr_t instr = { .op = op, .target = target };
+    return dlst_append(&(this_p->code), &instr);
+}
+
+void program_link(program_t* this_p)
+{
+    // a failed status skips to just past the next '||', a succeeded one to just past
+    // the next '&&'; scanning backwards the next ones are known at every jump
+    dlst_len_t const len = this_p->code.len;
+    dlst_len_t after_failed = len;
+    dlst_len_t after_succeeded = len;
+    for (dlst_len_t i = len; i-- > 0;)
+    {
+        program_instr_t* instr = dlst_at(&(this_p->code), i);
+        switch (instr->op)
+        {
+            case PROGRAM_OP_JUMP_IF_FAILED:
+                instr->target = after_failed;
+                after_succeeded = i + 1;
+                break;
+            case PROGRAM_OP_JUMP_IF_SUCCEEDED:
+                instr->target = after_succeeded;
+                after_failed = i + 1;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool program_exec(program_t* this_p, command_exec_status_t* exec_status)
+{
+    program_instr_t* const code = this_p->code.ptr;
+    dlst_len_t const len = this_p->code.len;
+
+    dlst_len_t pc = 0;
+    while (pc < len)
+    {
+        program_instr_t* instr = code + pc;
+        switch (instr->op)
+        {
+            case PROGRAM_OP_PIPELINE:
+                if (!command_pileline_exec(&(instr->pipeline), exec_status))
+                    return false;
+                ++pc;
+                break;
+
+            case PROGRAM_OP_JUMP_IF_FAILED:
+                pc = exec_status->code != 0 ? instr->target : pc + 1;
+                break;
+
+            case PROGRAM_OP_JUMP_IF_SUCCEEDED:
+                pc = exec_status->code == 0 ? instr->target : pc + 1;
+                break;
+
+            default:
+                fprintf(stderr, "Unexpected error: invalid instruction '%d'\n", instr->op);
+                exec_status->code = 1;
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void program_print_pipeline(dlst_t* pipeline, FILE* out)
+{
+    for (dlst_len_t i = 0; i < pipeline->len; ++i)
+    {
+        command_t const* c = dlst_at(pipeline, i);
+        fprintf(out, "%s'%s'", i ? " | " : "", c->executable.ptr);
+
+        // the arguments of a builtin do not start with its name
+        for (plst_len_t j = c->command_type == COMMAND_EXTERNAL ? 1 : 0; j < c->args.len; ++j)
+        {
+            if (c->args.ptr[j])
+                fprintf(out, " '%s'", (char const*)c->args.ptr[j]);
+        }
+
+        if (!dstr_is_null(&c->redir_in_from))
+            fprintf(out, " < '%s'", c->redir_in_from.ptr);
+        if (!dstr_is_null(&c->redir_out_to))
+            fprintf(out, " > '%s'", c->redir_out_to.ptr);
+    }
+}
+
+void program_print(program_t* this_p, FILE* out)
+{
+    for (dlst_len_t i = 0; i < this_p->code.len; ++i)
+    {
+        program_instr_t* instr = dlst_at(&(this_p->code), i);
+        fprintf(out, "%d: ", i);
+        switch (instr->op)
+        {
+            case PROGRAM_OP_PIPELINE:
+                fprintf(out, "run ");
+                program_print_pipeline(&(instr->pipeline), out);
+                break;
+            case PROGRAM_OP_JUMP_IF_FAILED:
+                fprintf(out, "jump if failed to %d", instr->target);
+                break;
+            case PROGRAM_OP_JUMP_IF_SUCCEEDED:
+                fprintf(out, "jump if succeeded to %d", instr->target);
+                break;
+            default:
+                fprintf(out, "invalid instruction '%d'", instr->op);
+                break;
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "command.h"
+#include "base/arena.h"
+#include "base/dlst.h"
+#include "base/bool.h"
+
+#include <stdio.h>
+
+// a command line compiled to a flat array of instructions, run by a loop
+// 'a && b || c' becomes:
+//     0: PIPELINE a
+//     1: JUMP_IF_FAILED 4
+//     2: PIPELINE b
+//     3: JUMP_IF_SUCCEEDED 5
+//     4: PIPELINE c
+// a jump skips the pipelines a failed '&&' or a succeeded '||' would not run, and the
+// operators after them that would not run them either, so no operator is tested twice
+
+typedef enum program_op_e
+{
+	PROGRAM_OP_PIPELINE = 0,    // runs 'pipeline', its status becomes the status
+	PROGRAM_OP_JUMP_IF_FAILED,  // goes to 'target' if the status is not 0
+	PROGRAM_OP_JUMP_IF_SUCCEEDED,
+}
+program_op_t;
+
+typedef struct program_instr_s
+{
+	program_op_t op;
+	union
+	{
+		dlst_t pipeline;        // of command_t
+		dlst_len_t target;      // index of the instruction to go to, 'code.len' to stop
+	};
+}
+program_instr_t;
+
+typedef struct program_s
+{
+	dlst_t code;                // of program_instr_t
+}
+program_t;
+
+// Construction
+// the program, its instructions and their pipelines live in 'arena', resetting the
+// arena releases them
+void program_init(program_t* this_p, arena_t* arena);
+
+// Compiling
+bool program_emit_pipeline(program_t* this_p, dlst_t const* pipeline);
+// 'combine_type' is COMMAND_COMBINE_AND or COMMAND_COMBINE_OR, the pipeline after the
+// operator is emitted next; the target is set by program_link()
+bool program_emit_combine(program_t* this_p, command_combine_type_t combine_type);
+// sets the targets of the jumps, once all the instructions are emitted
+void program_link(program_t* this_p);
+// emits a jump whose target is already known, e.g. read back from a cache
+bool program_emit_jump(program_t* this_p, program_op_t op, dlst_len_t target);
+
+// Running
+bool program_exec(program_t* this_p, command_exec_status_t* exec_status);
+
+// prints an instruction a line, e.g. "1: jump if failed to 4"
+void program_print(program_t* this_p, FILE* out);
@@ -0,0 +1,305 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "results.h"
+#include "program.h"
+#include "command.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#define results_BUFFER_SIZE (64 * 1024)
+
+static int results_fd = -1;
+static char results_buffer[results_BUFFER_SIZE];
+static size_t results_len;
+
+bool results_open(int fd)
+{
+    // the commands must not inherit it
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        fprintf(stderr, "error: results descriptor %d: %s\n", fd, strerror(errno));
+        return false;
+    }
+
+    results_fd = fd;
+    results_len = 0;
+    return true;
+}
+
+void results_close(void)
+{
+    results_flush();
+    results_fd = -1;
+}
+
+bool results_is_enabled(void)
+{
+    return results_fd != -1;
+}
+
+// a reader that went away must not stop the shell by SIGPIPE: the signal is blocked
+// while the buffer is written, and one raised by the writes is taken off the thread
+// before it is unblocked
+void results_flush(void)
+{
+    if (results_fd == -1 || !results_len)
+    {
+        results_len = 0;
+        return;
+    }
+
+    sigset_t sigpipe, old_mask, pending;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+
+    sigpending(&pending);
+    bool was_pending = sigismember(&pending, SIGPIPE);
+
+    size_t pos = 0;
+    while (results_fd != -1 && pos < results_len)
+    {
+        ssize_t n = write(results_fd, results_buffer + pos, results_len - pos);
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        // the reader went away, the shell goes on without it
+        if (n == -1)
+        {
+            fprintf(stderr, "error: results descriptor %d: %s\n", results_fd, strerror(errno));
+            results_fd = -1;
+            break;
+        }
+
+        pos += n;
+    }
+
+    if (!was_pending)
+    {
+        struct timespec no_wait = { 0, 0 };
+        while (sigtimedwait(&sigpipe, 0, &no_wait) == -1 && errno == EINTR)
+            ;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, 0);
+    results_len = 0;
+}
+
+static void results_append(char const* str, size_t len)
+{
+    while (len)
+    {
+        if (results_len == results_BUFFER_SIZE)
+            results_flush();
+
+        size_t n = results_BUFFER_SIZE - results_len < len ? results_BUFFER_SIZE - results_len : len;
+        memcpy(results_buffer + results_len, str, n);
+        results_len += n;
+        str += n;
+        len -= n;
+    }
+}
+
+static void results_printf(char const* format, ...)
+{
+    char buf[128];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (len > 0)
+        results_append(buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+}
+
+// the length of the UTF-8 sequence at 'p' that starts with a byte of 0x80 or more, 0 if
+// the sequence is not valid: overlong, a surrogate, over U+10FFFF or cut short
+static int results_utf8_length(unsigned char const* p)
+{
+    unsigned char c = p[0];
+    int len;
+    unsigned char min = 0x80, max = 0xbf;    // the range of the second byte
+    if (c >= 0xc2 && c <= 0xdf)
+        len = 2;
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        len = 3;
+        if (c == 0xe0)
+            min = 0xa0;
+        else if (c == 0xed)
+            max = 0x9f;
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        len = 4;
+        if (c == 0xf0)
+            min = 0x90;
+        else if (c == 0xf4)
+            max = 0x8f;
+    }
+    else
+        return 0;
+
+    if (p[1] < min || p[1] > max)
+        return 0;
+
+    for (int i = 2; i < len; ++i)
+    {
+        if ((p[i] & 0xc0) != 0x80)
+            return 0;
+    }
+
+    return len;
+}
+
+// a JSON string; valid UTF-8 is copied as it is, the quote, the backslash and the control
+// characters are escaped, and so is a byte that is not part of valid UTF-8, e.g. of the
+// name of a file, as '\u00XX' with its value
+static void results_string(char const* str)
+{
+    results_append("\"", 1);
+
+    char const* run = str;
+    while (*str)
+    {
+        unsigned char c = (unsigned char)*str;
+        if (c >= 0x80)
+        {
+            int len = results_utf8_length((unsigned char const*)str);
+            if (len)
+            {
+                str += len;
+                continue;
+            }
+        }
+        else if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            ++str;
+            continue;
+        }
+
+        results_append(run, str - run);
+        run = ++str;
+
+        switch (c)
+        {
+            case '"':  results_append("\\\"", 2); break;
+            case '\\': results_append("\\\\", 2); break;
+            case '\n': results_append("\\n", 2); break;
+            case '\t': results_append("\\t", 2); break;
+            default:   results_printf("\\u%04x", c); break;
+        }
+    }
+
+    results_append(run, str - run);
+    results_append("\"", 1);
+}
+
+static void results_command(command_t const* c)
+{
+    // the argv of an external command is built when it is launched; a builtin, a command
+    // that failed before and one whose arguments were split in batches report their own
+    plst_t const* argv = c->args_glob_refined.len ? &c->args_glob_refined : &c->args;
+
+    results_append("{\"argv\":[", 9);
+
+    bool is_first = true;
+    if (argv != &c->args_glob_refined && c->command_type != COMMAND_EXTERNAL)
+    {
+        results_string(c->executable.ptr);
+        is_first = false;
+    }
+
+    for (plst_len_t i = 0; i < argv->len; ++i)
+    {
+        if (!argv->ptr[i])
+            continue;
+
+        if (!is_first)
+            results_append(",", 1);
+        results_string(argv->ptr[i]);
+        is_first = false;
+    }
+
+    results_printf("],\"status\":%d}", c->status);
+}
+
+void results_line(long line, program_t* program, bool is_run, command_exec_status_t const* exec_status, long long wall_ns)
+{
+    if (results_fd == -1)
+        return;
+
+    long long user_us = 0;
+    long long sys_us = 0;
+    int status = -1;
+    for (dlst_len_t i = 0; i < program->code.len; ++i)
+    {
+        program_instr_t* instr = dlst_at(&program->code, i);
+        if (instr->op != PROGRAM_OP_PIPELINE)
+            continue;
+
+        for (dlst_len_t j = 0; j < instr->pipeline.len; ++j)
+        {
+            command_t const* c = dlst_at(&instr->pipeline, j);
+            user_us += c->user_us;
+            sys_us += c->sys_us;
+            if (c->is_run)
+                status = c->status;
+        }
+    }
+
+    // an 'exit' sets the status of the shell, a line that could not run has failed
+    if (exec_status->exit)
+        status = exec_status->code;
+    else if (!is_run && status == 0)
+        status = -1;
+
+    results_printf("{\"line\":%ld,\"status\":%d,\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"pipelines\":[",
+        line, status, wall_ns / 1e9, user_us / 1e6, sys_us / 1e6);
+
+    bool is_first = true;
+    for (dlst_len_t i = 0; i < program->code.len; ++i)
+    {
+        program_instr_t* instr = dlst_at(&program->code, i);
+        command_t const* first = instr->op == PROGRAM_OP_PIPELINE && instr->pipeline.len ? dlst_at(&instr->pipeline, 0) : 0;
+        if (!first || !first->is_run)
+            continue;
+
+        results_append(is_first ? "[" : ",[", is_first ? 1 : 2);
+        is_first = false;
+
+        for (dlst_len_t j = 0; j < instr->pipeline.len; ++j)
+        {
+            command_t const* c = dlst_at(&instr->pipeline, j);
+            if (!c->is_run)
+                break;
+
+            if (j)
+                results_append(",", 1);
+            results_command(c);
+        }
+
+        results_append("]", 1);
+    }
+
+    results_append("]}\n", 3);
+}
+
+void results_line_error(long line, char const* error)
+{
+    if (results_fd == -1)
+        return;
+
+    results_printf("{\"line\":%ld,\"status\":-1,\"error\":", line);
+    results_string(error);
+    results_append(",\"pipelines\":[]}\n", 17);
+}
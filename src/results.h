@@ -0,0 +1,29 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/bool.h"
+
+typedef struct program_s program_t;
+typedef struct command_exec_status_s command_exec_status_t;
+
+// a JSON object per command line written to a file descriptor for the program driving
+// the shell, e.g.
+// {"line":3,"status":1,"wall":0.002,"user":0.001,"sys":0.000,
+//  "pipelines":[[{"argv":["ls","*.c"],"status":0},{"argv":["grep","x"],"status":1}]]}
+// 'pipelines' holds the pipelines the line ran, in order, each with the argv of its
+// stages after the expansion of the wildcards and their exit status; the times are in
+// seconds, 'user' and 'sys' summed over the processes of the line; a line that does not
+// parse has a status of -1 and an "error"
+// the objects are buffered and written when the buffer fills, on results_flush() and
+// on results_close()
+
+bool results_open(int fd);
+void results_close(void);
+bool results_is_enabled(void);
+
+void results_line(long line, program_t* program, bool is_run, command_exec_status_t const* exec_status, long long wall_ns);
+void results_line_error(long line, char const* error);
+
+void results_flush(void);
@@ -0,0 +1,632 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// enable realpath() and the nanoseconds of st_mtim when using glibc
+#define _DEFAULT_SOURCE
+
+#include "scriptcache.h"
+#include "parser.h"
+#include "program.h"
+#include "command.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the format version is the last character
+#define script_cache_MAGIC "myshsc\0\1"
+#define script_cache_BYTE_ORDER 0x01020304u
+
+// all the references in the file are offsets from its start, 0 for none; the records
+// are 4 byte aligned
+typedef struct script_cache_header_s
+{
+    char magic[8];
+    uint32_t byte_order;        // a file written on a host of another byte order is stale
+    uint32_t line_count;
+    uint64_t size;              // of the cache file
+    uint64_t script_size;
+    int64_t  script_mtime_sec;
+    int64_t  script_mtime_nsec;
+    uint64_t script_hash;
+    uint32_t lines;             // script_cache_line_t[line_count]
+    uint32_t reserved;
+}
+script_cache_header_t;
+
+typedef struct script_cache_line_s
+{
+    uint32_t text;              // string
+    uint32_t code;              // script_cache_instr_t[code_len], none for a blank line
+    uint32_t code_len;
+}
+script_cache_line_t;
+
+typedef struct script_cache_instr_s
+{
+    uint32_t op;                // program_op_t
+    uint32_t arg;               // the pipeline of PROGRAM_OP_PIPELINE, the target of a jump
+}
+script_cache_instr_t;
+
+// a pipeline is a uint32_t count followed by its commands
+typedef struct script_cache_command_s
+{
+    uint32_t type;              // command_type_t
+    uint32_t executable;        // string
+    uint32_t redir_in;          // string
+    uint32_t redir_out;         // string
+    uint32_t args;              // uint32_t[arg_count] of strings, 0 for a zero item
+    uint32_t arg_count;
+}
+script_cache_command_t;
+
+// a string is a uint32_t length followed by the characters and a 0
+
+typedef struct script_cache_writer_s
+{
+    char* ptr;
+    size_t len;
+    size_t cap;
+    bool failed;                // out of memory or over 4G
+}
+script_cache_writer_t;
+
+typedef struct script_cache_stats_s
+{
+    long hits;
+    long misses;                // compiled and stored
+    long uncached;              // not cacheable, or no cache directory
+}
+script_cache_stats_t;
+
+static bool script_cache_enabled = true;
+static script_cache_stats_t script_cache_stats;
+
+void script_cache_enable(bool is_enabled)
+{
+    script_cache_enabled = is_enabled;
+}
+
+bool script_cache_is_enabled(void)
+{
+    return script_cache_enabled;
+}
+
+// 64 bits at a time, the content of the script is known to the key, not guarded
+static uint64_t script_cache_hash(char const* text, size_t size)
+{
+    uint64_t const prime = 0x100000001b3ull;
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, text + i, 8);
+        h = (h ^ w) * prime;
+        h ^= h >> 29;
+    }
+
+    for (; i < size; ++i)
+        h = (h ^ (unsigned char)text[i]) * prime;
+
+    return h ^ size;
+}
+
+// the cache file of 'file' is named after the hash of its absolute path
+static bool script_cache_path(char const* file, char* path, size_t path_size)
+{
+    char absolute[PATH_MAX];
+    if (!realpath(file, absolute))
+        return false;
+
+    char const* xdg = getenv("XDG_CACHE_HOME");
+    char const* home = getenv("HOME");
+    int l;
+    if (xdg && *xdg)
+        l = snprintf(path, path_size, "%s/mysh", xdg);
+    else if (home && *home)
+    {
+        l = snprintf(path, path_size, "%s/.cache", home);
+        if (l > 0 && (size_t)l < path_size)
+            mkdir(path, 0700);
+        l = snprintf(path, path_size, "%s/.cache/mysh", home);
+    }
+    else
+        return false;
+
+    if (l < 0 || (size_t)l >= path_size)
+        return false;
+
+    if (mkdir(path, 0700) == -1 && errno != EEXIST)
+        return false;
+
+    l = snprintf(path + l, path_size - l, "/%016llx.msc",
+        (unsigned long long)script_cache_hash(absolute, strlen(absolute)));
+    return l > 0 && (size_t)l < path_size;
+}
+
+// Writing
+
+// returns the offset of 'size' zeroed bytes, 0 on a failure
+static uint32_t script_cache_writer_alloc(script_cache_writer_t* w, size_t size)
+{
+    size = (size + 3) & ~(size_t)3;
+    if (w->failed || w->len + size > UINT32_MAX)
+    {
+        w->failed = true;
+        return 0;
+    }
+
+    if (w->len + size > w->cap)
+    {
+        size_t cap = w->cap ? w->cap * 2 : 64 * 1024;
+        while (cap < w->len + size)
+            cap *= 2;
+
+        char* p = realloc(w->ptr, cap);
+        if (!p)
+        {
+            fprintf(stderr,"No enough memory.\n");
+            w->failed = true;
+            return 0;
+        }
+
+        w->ptr = p;
+        w->cap = cap;
+    }
+
+    uint32_t offset = (uint32_t)w->len;
+    memset(w->ptr + offset, 0, size);
+    w->len += size;
+    return offset;
+}
+
+// the buffer moves as it grows, a record is reached through its offset after each alloc
+static void* script_cache_writer_at(script_cache_writer_t* w, uint32_t offset)
+{
+    return w->ptr + offset;
+}
+
+static uint32_t script_cache_write_string(script_cache_writer_t* w, char const* str, size_t len)
+{
+    if (!str)
+        return 0;
+
+    uint32_t offset = script_cache_writer_alloc(w, sizeof(uint32_t) + len + 1);
+    if (!offset)
+        return 0;
+
+    uint32_t l = (uint32_t)len;
+    memcpy(script_cache_writer_at(w, offset), &l, sizeof(l));
+    memcpy((char*)script_cache_writer_at(w, offset) + sizeof(l), str, len);
+    return offset;
+}
+
+static uint32_t script_cache_write_dstr(script_cache_writer_t* w, dstr_t const* str)
+{
+    if (dstr_is_null(str))
+        return 0;
+
+    return script_cache_write_string(w, str->ptr, str->len);
+}
+
+static uint32_t script_cache_write_pipeline(script_cache_writer_t* w, dlst_t* pipeline)
+{
+    uint32_t count = (uint32_t)pipeline->len;
+    uint32_t offset = script_cache_writer_alloc(w, sizeof(uint32_t) + count * sizeof(script_cache_command_t));
+    if (!offset)
+        return 0;
+
+    memcpy(script_cache_writer_at(w, offset), &count, sizeof(count));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        command_t const* c = dlst_at(pipeline, i);
+
+        script_cache_command_t rec;
+        rec.type = c->command_type;
+        rec.executable = script_cache_write_dstr(w, &c->executable);
+        rec.redir_in = script_cache_write_dstr(w, &c->redir_in_from);
+        rec.redir_out = script_cache_write_dstr(w, &c->redir_out_to);
+        rec.arg_count = (uint32_t)c->args.len;
+        rec.args = script_cache_writer_alloc(w, rec.arg_count * sizeof(uint32_t));
+        for (uint32_t j = 0; j < rec.arg_count && !w->failed; ++j)
+        {
+            char const* arg = c->args.ptr[j];
+            uint32_t s = arg ? script_cache_write_string(w, arg, strlen(arg)) : 0;
+            memcpy((uint32_t*)script_cache_writer_at(w, rec.args) + j, &s, sizeof(s));
+        }
+
+        if (w->failed)
+            return 0;
+
+        memcpy((char*)script_cache_writer_at(w, offset) + sizeof(uint32_t) + i * sizeof(rec), &rec, sizeof(rec));
+    }
+
+    return offset;
+}
+
+static bool script_cache_write_program(script_cache_writer_t* w, program_t* program, uint32_t line_offset)
+{
+    uint32_t code_len = (uint32_t)program->code.len;
+    uint32_t code = script_cache_writer_alloc(w, code_len * sizeof(script_cache_instr_t));
+    for (uint32_t i = 0; i < code_len && !w->failed; ++i)
+    {
+        program_instr_t* instr = dlst_at(&program->code, i);
+        script_cache_instr_t rec = { .op = instr->op };
+        if (instr->op == PROGRAM_OP_PIPELINE)
+            rec.arg = script_cache_write_pipeline(w, &instr->pipeline);
+        else
+            rec.arg = (uint32_t)instr->target;
+
+        if (!w->failed)
+            memcpy((script_cache_instr_t*)script_cache_writer_at(w, code) + i, &rec, sizeof(rec));
+    }
+
+    if (w->failed)
+        return false;
+
+    script_cache_line_t* line = script_cache_writer_at(w, line_offset);
+    line->code = code;
+    line->code_len = code_len;
+    return true;
+}
+
+// compiles the lines of the script, only the ones ended by a '\n' as run_interal() reads
+// no other; false if a line does not parse
+static bool script_cache_compile(script_cache_writer_t* w, char const* text, size_t size, uint32_t* line_count, uint32_t* lines)
+{
+    uint32_t count = 0;
+    for (char const* p = text; (p = memchr(p, '\n', size - (p - text))); ++p)
+        ++count;
+
+    *line_count = count;
+    *lines = script_cache_writer_alloc(w, count * sizeof(script_cache_line_t));
+    if (w->failed)
+        return false;
+
+    arena_t arena;
+    arena_init(&arena);
+
+    bool result = true;
+    char const* start = text;
+    for (uint32_t i = 0; result && i < count; ++i)
+    {
+        char const* end = memchr(start, '\n', size - (start - text)) + 1;
+        uint32_t line_offset = *lines + i * sizeof(script_cache_line_t);
+
+        uint32_t s = script_cache_write_string(w, start, end - start);
+        if (w->failed)
+        {
+            result = false;
+            break;
+        }
+        ((script_cache_line_t*)script_cache_writer_at(w, line_offset))->text = s;
+
+        if (*start != '\n')
+        {
+            // the lexer stops at the '\n', the line needs no terminating 0
+            arena_reset(&arena);
+            program_t* program = parse_command_line_quiet(start, &arena);
+            result = program && script_cache_write_program(w, program, line_offset);
+        }
+
+        start = end;
+    }
+
+    arena_term(&arena);
+    return result;
+}
+
+static bool script_cache_write_file(char const* path, char const* ptr, size_t size)
+{
+    char tmp[4096 + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return false;
+
+    bool result = true;
+    for (size_t done = 0; result && done < size;)
+    {
+        ssize_t n = write(fd, ptr + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        result = n > 0;
+        done += result ? (size_t)n : 0;
+    }
+
+    result = close(fd) == 0 && result;
+
+    // another run may be storing the same script, the last rename wins whole
+    if (!result || rename(tmp, path) == -1)
+    {
+        unlink(tmp);
+        return false;
+    }
+
+    return true;
+}
+
+static bool script_cache_store(script_cache_t* this_p, struct stat const* st, uint64_t hash, char const* text)
+{
+    script_cache_writer_t w = { .ptr = 0, .len = 0, .cap = 0, .failed = false };
+
+    bool result = script_cache_writer_alloc(&w, sizeof(script_cache_header_t)) == 0 && !w.failed;
+
+    uint32_t line_count = 0;
+    uint32_t lines = 0;
+    result = result && script_cache_compile(&w, text, st->st_size, &line_count, &lines);
+
+    if (result)
+    {
+        script_cache_header_t* header = script_cache_writer_at(&w, 0);
+        memcpy(header->magic, script_cache_MAGIC, sizeof(header->magic));
+        header->byte_order = script_cache_BYTE_ORDER;
+        header->line_count = line_count;
+        header->size = w.len;
+        header->script_size = st->st_size;
+        header->script_mtime_sec = st->st_mtim.tv_sec;
+        header->script_mtime_nsec = st->st_mtim.tv_nsec;
+        header->script_hash = hash;
+        header->lines = lines;
+
+        result = script_cache_write_file(this_p->path, w.ptr, w.len);
+    }
+
+    free(w.ptr);
+    return result;
+}
+
+// Reading
+
+// a record of 'size' bytes at 'offset', 0 if it is not inside the file
+static void const* script_cache_at(script_cache_t const* this_p, uint32_t offset, size_t size)
+{
+    if (!offset || size > this_p->size || offset > this_p->size - size)
+        return 0;
+
+    return this_p->base + offset;
+}
+
+static bool script_cache_string(script_cache_t const* this_p, uint32_t offset, char const** str, uint32_t* len)
+{
+    *str = 0;
+    *len = 0;
+    if (!offset)
+        return true;
+
+    uint32_t const* l = script_cache_at(this_p, offset, sizeof(uint32_t));
+    if (!l)
+        return false;
+
+    char const* s = script_cache_at(this_p, offset + sizeof(uint32_t), (size_t)*l + 1);
+    if (!s || s[*l] != 0)
+        return false;
+
+    *str = s;
+    *len = *l;
+    return true;
+}
+
+static bool script_cache_map(script_cache_t* this_p, struct stat const* st, uint64_t hash)
+{
+    int fd = open(this_p->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat cst;
+    bool result = fstat(fd, &cst) == 0 && (size_t)cst.st_size >= sizeof(script_cache_header_t);
+    void* base = result ? mmap(0, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (base == MAP_FAILED)
+        return false;
+
+    script_cache_header_t const* header = base;
+    result = memcmp(header->magic, script_cache_MAGIC, sizeof(header->magic)) == 0
+          && header->byte_order == script_cache_BYTE_ORDER
+          && header->size == (uint64_t)cst.st_size
+          && header->script_size == (uint64_t)st->st_size
+          && header->script_mtime_sec == st->st_mtim.tv_sec
+          && header->script_mtime_nsec == st->st_mtim.tv_nsec
+          && header->script_hash == hash;
+
+    this_p->base = base;
+    this_p->size = cst.st_size;
+    this_p->line_count = header->line_count;
+    if (!result || !script_cache_at(this_p, header->lines, (size_t)header->line_count * sizeof(script_cache_line_t)))
+    {
+        munmap(base, cst.st_size);
+        this_p->base = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool script_cache_open(script_cache_t* this_p, char const* file)
+{
+    this_p->base = 0;
+    this_p->size = 0;
+    this_p->line_count = 0;
+
+    if (!script_cache_enabled)
+        return false;
+
+    // a file that cannot be read is reported by the run line by line
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    char const* text = "";
+    bool is_mapped = false;
+    bool result = fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+               && script_cache_path(file, this_p->path, sizeof(this_p->path));
+    if (result && st.st_size)
+    {
+        void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        result = is_mapped = p != MAP_FAILED;
+        text = is_mapped ? p : "";
+    }
+
+    close(fd);
+
+    uint64_t hash = result ? script_cache_hash(text, st.st_size) : 0;
+    if (!result)
+        ++script_cache_stats.uncached;
+    else if (script_cache_map(this_p, &st, hash))
+        ++script_cache_stats.hits;
+    else if (script_cache_store(this_p, &st, hash, text) && script_cache_map(this_p, &st, hash))
+        ++script_cache_stats.misses;
+    else
+    {
+        ++script_cache_stats.uncached;
+        result = false;
+    }
+
+    if (is_mapped)
+        munmap((void*)text, st.st_size);
+
+    return result;
+}
+
+void script_cache_close(script_cache_t* this_p)
+{
+    if (this_p->base)
+        munmap((void*)this_p->base, this_p->size);
+
+    this_p->base = 0;
+}
+
+char const* script_cache_line_text(script_cache_t const* this_p, uint32_t line, size_t* len)
+{
+    script_cache_header_t const* header = (script_cache_header_t const*)this_p->base;
+    script_cache_line_t const* l = (script_cache_line_t const*)(this_p->base + header->lines) + line;
+
+    char const* str;
+    uint32_t str_len;
+    if (!script_cache_string(this_p, l->text, &str, &str_len) || !str)
+    {
+        *len = 1;
+        return "\n";
+    }
+
+    *len = str_len;
+    return str;
+}
+
+static bool script_cache_read_pipeline(script_cache_t const* this_p, uint32_t offset, arena_t* arena, dlst_t* pipeline)
+{
+    uint32_t const* count = script_cache_at(this_p, offset, sizeof(uint32_t));
+    if (!count || *count == 0)
+        return false;
+
+    script_cache_command_t const* recs = script_cache_at(this_p, offset + sizeof(uint32_t), (size_t)*count * sizeof(script_cache_command_t));
+    if (!recs)
+        return false;
+
+    dlst_init_arena(pipeline, sizeof(command_t), arena);
+    for (uint32_t i = 0; i < *count; ++i)
+    {
+        script_cache_command_t const* rec = recs + i;
+        if (rec->type > COMMAND_BUILTIN_HASH)
+            return false;
+
+        command_t cmd;
+        command_init(&cmd, arena);
+        cmd.command_type = rec->type;
+
+        char const* str;
+        uint32_t len;
+        if (!script_cache_string(this_p, rec->executable, &str, &len) || (str && !dstr_assign_view(&cmd.executable, str, len)))
+            return false;
+        if (!script_cache_string(this_p, rec->redir_in, &str, &len) || (str && !dstr_assign_view(&cmd.redir_in_from, str, len)))
+            return false;
+        if (!script_cache_string(this_p, rec->redir_out, &str, &len) || (str && !dstr_assign_view(&cmd.redir_out_to, str, len)))
+            return false;
+
+        // the arguments are not copied, they are only read and the file stays mapped
+        // while the line runs
+        uint32_t const* args = rec->arg_count ? script_cache_at(this_p, rec->args, (size_t)rec->arg_count * sizeof(uint32_t)) : 0;
+        if (rec->arg_count && !args)
+            return false;
+
+        for (uint32_t j = 0; j < rec->arg_count; ++j)
+        {
+            if (!script_cache_string(this_p, args[j], &str, &len))
+                return false;
+            if (!(str ? plst_append(&cmd.args, (plst_item_t)str) : plst_append_zero(&cmd.args)))
+                return false;
+        }
+
+        if (!dlst_append(pipeline, &cmd))
+            return false;
+    }
+
+    return true;
+}
+
+program_t* script_cache_line_program(script_cache_t const* this_p, uint32_t line, arena_t* arena)
+{
+    script_cache_header_t const* header = (script_cache_header_t const*)this_p->base;
+    script_cache_line_t const* l = (script_cache_line_t const*)(this_p->base + header->lines) + line;
+
+    script_cache_instr_t const* code = script_cache_at(this_p, l->code, (size_t)l->code_len * sizeof(script_cache_instr_t));
+    program_t* program = arena_alloc(arena, sizeof(program_t));
+    bool result = code && l->code_len && program;
+    if (result)
+        program_init(program, arena);
+
+    for (uint32_t i = 0; result && i < l->code_len; ++i)
+    {
+        switch (code[i].op)
+        {
+            case PROGRAM_OP_PIPELINE:
+            {
+                dlst_t pipeline;
+                result = script_cache_read_pipeline(this_p, code[i].arg, arena, &pipeline)
+                      && program_emit_pipeline(program, &pipeline);
+                break;
+            }
+            case PROGRAM_OP_JUMP_IF_FAILED:
+            case PROGRAM_OP_JUMP_IF_SUCCEEDED:
+                result = code[i].arg <= l->code_len && program_emit_jump(program, code[i].op, code[i].arg);
+                break;
+            default:
+                result = false;
+                break;
+        }
+    }
+
+    if (result)
+        return program;
+
+    // a file cut or overwritten under the run, the next run compiles the script again
+    fprintf(stderr, "error: script cache '%s' is corrupted\n", this_p->path);
+    unlink(this_p->path);
+    return 0;
+}
+
+void script_cache_stats_print(void)
+{
+    if (!script_cache_enabled)
+    {
+        fprintf(stderr, "script cache  : off\n");
+        return;
+    }
+
+    long opens = script_cache_stats.hits + script_cache_stats.misses + script_cache_stats.uncached;
+    fprintf(stderr, "script cache  : %ld hits, %ld misses, %ld not cacheable, %.1f%% hit rate\n",
+        script_cache_stats.hits, script_cache_stats.misses, script_cache_stats.uncached,
+        opens ? 100.0 * script_cache_stats.hits / opens : 0.0);
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "base/arena.h"
+#include "base/bool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct program_s program_t;
+
+// on-disk cache of the compiled form of batch scripts
+// a script is compiled whole on its first run and the programs of all its lines are
+// written to '$XDG_CACHE_HOME/mysh' (or '~/.cache/mysh'), in a file named after the
+// path of the script; the file holds offsets only, so it is mapped as it is and a run
+// that finds it up to date does not lex nor parse a line
+// a cache file is up to date when the size, mtime and content hash of the script are
+// the ones it was compiled from; a script with a line that does not parse is not cached
+
+typedef struct script_cache_s
+{
+    char const* base;       // the mapped cache file
+    size_t size;
+    uint32_t line_count;
+    char path[4096];        // of the cache file
+}
+script_cache_t;
+
+void script_cache_enable(bool is_enabled);
+bool script_cache_is_enabled(void);
+
+// maps the compiled form of 'file', compiling and storing it first if the cache has
+// none or a stale one; false if the script is not cached, it is then run line by line
+bool script_cache_open(script_cache_t* this_p, char const* file);
+void script_cache_close(script_cache_t* this_p);
+
+// the text of line 'line', its terminating '\n' included
+char const* script_cache_line_text(script_cache_t const* this_p, uint32_t line, size_t* len);
+// builds the program of line 'line' in 'arena', its strings stay in the mapped file
+// 0 if the cache file is corrupted or memory runs out
+program_t*  script_cache_line_program(script_cache_t const* this_p, uint32_t line, arena_t* arena);
+
+void script_cache_stats_print(void);
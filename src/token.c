@@ -15,6 +15,8 @@ char const* token_type_to_str(token_type_t tt)
             return "COMMAND_CD";
         case TOKEN_COMMAND_PWD:
             return "COMMAND_PWD";
+        case TOKEN_COMMAND_HASH:
+            return "COMMAND_HASH";
         case TOKEN_PATH:
             return "PATH";        
         case TOKEN_WILDCARD:
@@ -36,10 +38,20 @@ char const* token_type_to_str(token_type_t tt)
 
 void token_init(token_t* t)
 {
+    t->ptr = "";
+    t->len = 0;
     dstr_init(&(t->token_text));
     t->token_type = TOKEN_ERROR;
 }
 
+void token_init_arena(token_t* t, arena_t* arena)
+{
+    t->ptr = "";
+    t->len = 0;
+    dstr_init_arena(&(t->token_text), arena);
+    t->token_type = TOKEN_ERROR;
+}
+
 void token_term(token_t* t)
 {
     dstr_term(&(t->token_text));
@@ -47,9 +59,8 @@ void token_term(token_t* t)
 
 int token_compose(token_t* t, token_type_t type, char const* ptr, dstr_len_t len)
 {
-    if (!dstr_assign_view(&(t->token_text), ptr, len))
-        return 0;
-
+    t->ptr = ptr;
+    t->len = len;
     t->token_type = type;
     return 1;
 }
@@ -8,14 +8,19 @@
 
 char const* token_type_to_str(token_type_t tt);
 
+// the text of a token is 'ptr'/'len', not 0 terminated: a view into the lexed line,
+// or into 'token_text' when the token had escapes to translate
 typedef struct token_s
 {
+	char const* ptr;
+	dstr_len_t len;
 	dstr_t token_text;
 	token_type_t token_type;
 }
 token_t;
 
 void token_init(token_t* t);
+void token_init_arena(token_t* t, arena_t* arena);
 void token_term(token_t* t);
 
 int token_compose(token_t* t, token_type_t type, char const* ptr, dstr_len_t len);
@@ -0,0 +1,92 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// runs the builtin utilities on argument lists and checks what they print and their exit
+// code against the GNU utilities
+
+#include "builtin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct case_s
+{
+    char* argv[8];
+    char const* expected;   // 0 for a declined argument list
+    int code;
+}
+case_t;
+
+static case_t const cases[] =
+{
+    { { "echo", 0 },                                    "\n",               0 },
+    { { "echo", "hello", "world", 0 },                  "hello world\n",    0 },
+    { { "echo", "-n", "hi", 0 },                        "hi",               0 },
+    { { "echo", "-e", "a\\tb\\nc", 0 },                 "a\tb\nc\n",        0 },
+    { { "echo", "-E", "a\\tb", 0 },                     "a\\tb\n",          0 },
+    { { "echo", "-nx", "a", 0 },                        "-nx a\n",          0 },
+    { { "echo", "-", "a", 0 },                          "- a\n",            0 },
+    { { "echo", "-e", "a\\cb", "c", 0 },                "a",                0 },
+    { { "echo", "-e", "\\0101\\101\\x41\\x4g\\xZ\\q", 0 }, "AAA\x04g\\xZ\\q\n", 0 },
+    { { "echo", "--help", 0 },                          0,                  0 },
+    { { "true", "x", 0 },                               "",                 0 },
+    { { "false", 0 },                                   "",                 1 },
+    { { "false", "--version", 0 },                      0,                  0 },
+    { { "test", 0 },                                    "",                 1 },
+    { { "test", "abc", 0 },                             "",                 0 },
+    { { "test", "-z", "abc", 0 },                       "",                 1 },
+    { { "test", "-d", ".", 0 },                         "",                 0 },
+    { { "test", "-f", ".", 0 },                         "",                 1 },
+    { { "test", "a", "!=", "a", 0 },                    "",                 1 },
+    { { "test", "3", "-lt", "10", 0 },                  "",                 0 },
+    { { "test", "-3", "-le", "-3", 0 },                 "",                 0 },
+    { { "test", "4", "-ge", "5", 0 },                   "",                 1 },
+    { { "test", "!", "a", "=", "b", 0 },                "",                 0 },
+    { { "test", "(", "-z", "a", ")", 0 },               "",                 1 },
+    { { "test", "3", "-eq", "x", 0 },                   0,                  0 },
+    { { "test", "-q", "x", 0 },                         0,                  0 },
+    { { "test", "a", "b", "c", "d", "e", 0 },           0,                  0 },
+    { { "printf", "%s\\n", "a", "b", 0 },               "a\nb\n",           0 },
+    { { "printf", "%d-%i\\n", "1", "2", "3", 0 },       "1-2\n3-0\n",       0 },
+    { { "printf", "%5d|%-5d|%05d\\n", "42", "42", "42", 0 }, "   42|42   |00042\n", 0 },
+    { { "printf", "%x-%X-%o\\n", "255", "255", "8", 0 }, "ff-FF-10\n",      0 },
+    { { "printf", "%c%c\\n", "abc", "d", 0 },           "ad\n",             0 },
+    { { "printf", "%b\\n", "a\\tb", "\\0101", 0 },      "a\tb\nA\n",        0 },
+    { { "printf", "a\\x41\\101\\\"\\n", 0 },            "aAA\"\n",          0 },
+    { { "printf", "%d %d\\n", "'A", "0x1f", 0 },        "65 31\n",          0 },
+    { { "printf", "%s\\c-%s\\n", "a", "b", 0 },         "a",                0 },
+    { { "printf", "%.3s|%10s|\\n", "abcdef", "ab", 0 }, "abc|        ab|\n", 0 },
+    { { "printf", "%d\\n", "abc", 0 },                  0,                  0 },
+    { { "printf", "%f\\n", "1.5", 0 },                  0,                  0 },
+    { { "printf", "%*d", "5", "3", 0 },                 0,                  0 },
+    { { "printf", "x\\n", "a", 0 },                     0,                  0 },
+    { { "printf", 0 },                                  0,                  0 },
+};
+
+int main(void)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        case_t const* c = &cases[i];
+
+        dstr_t out;
+        dstr_init(&out);
+
+        builtin_t builtin = builtin_find(c->argv[0]);
+        int code = builtin ? builtin(c->argv, &out) : builtin_DECLINED;
+        char const* printed = out.ptr ? out.ptr : "";
+
+        bool is_ok = c->expected
+            ? code == c->code && (size_t)out.len == strlen(c->expected) && memcmp(printed, c->expected, out.len) == 0
+            : code == builtin_DECLINED;
+
+        printf("%s %s %s -> %d '%.*s'\n", is_ok ? "ok  " : "FAIL", c->argv[0], c->argv[1] ? c->argv[1] : "", code, out.len, printed);
+        if (!is_ok)
+            ++failed;
+
+        dstr_term(&out);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
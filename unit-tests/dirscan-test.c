@@ -0,0 +1,162 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// reads a directory, forgets the types of its entries and checks that resolving them
+// again gives the types the file system reported; then removes half of the files of a
+// new directory after reading it, so their statx requests fail, and checks the failures
+// leave those entries unknown and do not lose the types of the others
+
+// enable DT_UNKNOWN when using glibc
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dirscan.h"
+
+static int check_removed(void)
+{
+    char dname[] = "/tmp/dirscan-test-XXXXXX";
+    if (!mkdtemp(dname))
+    {
+        perror(dname);
+        return EXIT_FAILURE;
+    }
+
+    int dfd = open(dname, O_RDONLY | O_DIRECTORY);
+    if (dfd == -1)
+    {
+        perror(dname);
+        rmdir(dname);
+        return EXIT_FAILURE;
+    }
+
+    enum { file_count = 16 };
+    char name[16];
+    for (int i = 0; i < file_count; ++i)
+    {
+        snprintf(name, sizeof(name), "f%d", i);
+        int fd = openat(dfd, name, O_WRONLY | O_CREAT, 0600);
+        if (fd != -1)
+            close(fd);
+    }
+
+    int exit_code = EXIT_SUCCESS;
+    dir_listing_t listing;
+    char* entries[file_count + 2];
+    int count = 0;
+    if (!dir_scan_read(dfd, &listing) || listing.count > file_count + 2)
+        exit_code = EXIT_FAILURE;
+    else
+    {
+        char* end = listing.names + listing.size;
+        for (char* p = listing.names; p < end; p = dir_listing_NEXT(p))
+        {
+            if (p[1] == 'f')
+            {
+                p[0] = DT_UNKNOWN;
+                entries[count++] = p;
+            }
+        }
+
+        for (int i = 1; i < file_count; i += 2)
+        {
+            snprintf(name, sizeof(name), "f%d", i);
+            unlinkat(dfd, name, 0);
+        }
+
+        dir_scan_resolve_types(dfd, entries, count);
+
+        int resolved = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            int n = atoi(entries[i] + 2);
+            char expected = (n % 2) ? DT_UNKNOWN : DT_REG;
+            if (entries[i][0] != expected)
+            {
+                printf("%s: resolved %d, expected %d\n", entries[i] + 1, entries[i][0], expected);
+                exit_code = EXIT_FAILURE;
+            }
+            resolved += entries[i][0] == DT_REG;
+        }
+
+        printf("%d of %d entries resolved after removing %d\n", resolved, count, file_count / 2);
+        if (count != file_count)
+            exit_code = EXIT_FAILURE;
+
+        dir_listing_term(&listing);
+    }
+
+    for (int i = 0; i < file_count; i += 2)
+    {
+        snprintf(name, sizeof(name), "f%d", i);
+        unlinkat(dfd, name, 0);
+    }
+    close(dfd);
+    rmdir(dname);
+    return exit_code;
+}
+
+int main(int argc, char **argv)
+{
+    char const* dname = (argc < 2) ? "." : argv[1];
+
+    int dfd = open(dname, O_RDONLY | O_DIRECTORY);
+    if (dfd == -1)
+    {
+        perror(dname);
+        return EXIT_FAILURE;
+    }
+
+    dir_listing_t listing;
+    if (!dir_scan_read(dfd, &listing))
+    {
+        perror(dname);
+        close(dfd);
+        return EXIT_FAILURE;
+    }
+
+    char* types = malloc(listing.count + 1);
+    char** entries = malloc((listing.count + 1) * sizeof(char*));
+    if (!types || !entries)
+        return EXIT_FAILURE;
+
+    int count = 0;
+    char* end = listing.names + listing.size;
+    for (char* p = listing.names; p < end; p = dir_listing_NEXT(p))
+    {
+        types[count] = p[0];
+        entries[count] = p;
+        p[0] = DT_UNKNOWN;
+        ++count;
+    }
+
+    dir_scan_resolve_types(dfd, entries, count);
+
+    int exit_code = (count == listing.count) ? EXIT_SUCCESS : EXIT_FAILURE;
+    for (int i = 0; i < count; ++i)
+    {
+        // a file system that does not report types has nothing to compare with
+        if (types[i] != entries[i][0] && types[i] != DT_UNKNOWN)
+        {
+            printf("%s: type %d, resolved %d\n", entries[i] + 1, types[i], entries[i][0]);
+            exit_code = EXIT_FAILURE;
+        }
+    }
+
+    printf("%d entries\n", count);
+    if (check_removed() != EXIT_SUCCESS)
+        exit_code = EXIT_FAILURE;
+    dir_scan_stats_print();
+
+    free(types);
+    free(entries);
+    dir_listing_term(&listing);
+    dir_scan_thread_term();
+    close(dfd);
+    return exit_code;
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+#include "globmatch.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct case_s
+{
+    char const* pattern;
+    char const* str;
+    bool expected;
+}
+case_t;
+
+static case_t const cases[] =
+{
+    { "*",           "abc",         true  },
+    { "*",           "",            true  },
+    { "",            "",            true  },
+    { "",            "a",           false },
+    { "abc",         "abc",         true  },
+    { "abc",         "abd",         false },
+    { "*.txt",       "1.txt",       true  },
+    { "*.txt",       "1.txt.bak",   false },
+    { "a*c",         "abbbc",       true  },
+    { "a*c",         "ac",          true  },
+    { "a*c",         "acb",         false },
+    { "a**c",        "abc",         true  },
+    { "?",           "a",           true  },
+    { "?",           "",            false },
+    { "?.c",         "f.c",         true  },
+    { "??.c",        "f.c",         false },
+    { "[abc]x",      "bx",          true  },
+    { "[abc]x",      "dx",          false },
+    { "[a-z]*",      "q1",          true  },
+    { "[a-z]*",      "Q1",          false },
+    { "[!x]*",       "abc",         true  },
+    { "[!x]*",       "xbc",         false },
+    { "[^x]",        "y",           true  },
+    { "[]]",         "]",           true  },
+    { "[!]]",        "]",           false },
+    { "[a-]",        "-",           true  },
+    { "[ab",         "[ab",         true  },
+    { "f_[0-9].c",   "f_1.c",       true  },
+    { "build_*_x86.o", "build_foo_x86.o", true },
+    { "build_*_x86.o", "build_foo_arm.o", false },
+    { "*a*a*a*a*a*a*a*b", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", false },
+    { "*a*a*a*a*a*a*a*b", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", true  },
+    { "*foo*",       "xfoox",       true  },
+    { "*foo*",       "xfoxo",       false },
+    { "*fo?o*",      "afoxob",      true  },
+    { "ab*ba",       "aba",         false },
+    { "ab*ba",       "abba",        true  },
+    { "a*bc*d",      "abcbd",       true  },
+    { "a*bc*d",      "abdcd",       false },
+    // names long enough for the vector prefilter
+    { "*.txt",       "a_rather_long_file_name.txt", true  },
+    { "*.txt",       "a_rather_long_file_name.tx",  false },
+    { "build_*_x86.o", "build_some_long_target_x86.o", true  },
+    { "build_*_x86.o", "build_some_long_target_x64.o", false },
+    { "*needle*",    "hay_hay_hay_hay_hay_hay_hay_hay_hay_needle_hay", true  },
+    { "*needle*",    "hay_hay_hay_hay_hay_hay_hay_hay_hay_needl_hay",  false },
+    { "*n*",         "hay_hay_hay_hay_hay_hay_hay_hay_hay_hay_hay_hay", false },
+    { "*y*",         "hay_hay_hay_hay_hay_hay_hay_hay_hay_hay_hay_hay", true  },
+    { "pre[0-9]*_a_literal_longer_than_the_anchor_limit",
+      "pre1_x_a_literal_longer_than_the_anchor_limit", true  },
+    { "pre[0-9]*_a_literal_longer_than_the_anchor_limit",
+      "pre1_x_b_literal_longer_than_the_anchor_limit", false },
+    { "*_a_literal_longer_than_the_anchor_limit_*",
+      "x_a_literal_longer_than_the_anchor_limit_y", true  },
+    { "*_a_literal_longer_than_the_anchor_limit_*",
+      "x_a_literal_longer_than_the_anchor_limjt_y", false },
+    // more than 63 pattern positions, the state set spans several words
+    { "0123456789012345678901234567890123456789012345678901234567890123456789*",
+      "0123456789012345678901234567890123456789012345678901234567890123456789xyz", true },
+    { "0123456789012345678901234567890123456789012345678901234567890123456789?",
+      "0123456789012345678901234567890123456789012345678901234567890123456789", false },
+    { "*0123456789012345678901234567890123456789012345678901234567890123456789",
+      "xx0123456789012345678901234567890123456789012345678901234567890123456789", true },
+};
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        case_t const* c = &cases[i];
+
+        glob_matcher_t m;
+        if (!glob_matcher_compile(&m, c->pattern, c->pattern + strlen(c->pattern)))
+            return 1;
+
+        bool r = glob_matcher_match(&m, c->str);
+        glob_matcher_term(&m);
+
+        printf("%s '%s' '%s' -> %d\n", (r == c->expected) ? "ok  " : "FAIL", c->pattern, c->str, r);
+        if (r != c->expected)
+            ++failed;
+    }
+
+    return failed ? 1 : 0;
+}
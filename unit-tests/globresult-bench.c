@@ -0,0 +1,135 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// times the sort of an expansion: the multikey quicksort of glob_result_sort_by_tag()
+// against qsort() with strcmp() on the built paths and qsort() on the compact result
+// usage: globresult-bench [count ...], 100000 300000 1000000 by default
+
+// enable clock_gettime() when using glibc
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "globresult.h"
+
+static double bench_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// a tree like a build directory: many files under a few long directory paths, pushed
+// in a scrambled order as a file system lists them
+static bool bench_result_build(glob_result_t* result, size_t count)
+{
+    int root = glob_result_dir_push(result, -1, "./build/output/objects", 22);
+    int dirs[64];
+    for (int i = 0; i < 64; ++i)
+    {
+        char name[32];
+        int l = snprintf(name, sizeof(name), "module_%02d", (i * 37) % 64);
+        dirs[i] = glob_result_dir_push(result, root, name, l);
+        if (dirs[i] == -1)
+            return false;
+    }
+
+    unsigned seed = 12345;
+    for (size_t i = 0; i < count; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        char name[64];
+        int l = snprintf(name, sizeof(name), "f_%07u_%s.o", (seed >> 8) % 10000000, (seed & 1) ? "x86" : "arm");
+        if (!glob_result_file_push(result, dirs[(seed >> 4) % 64], 0, name, l))
+            return false;
+    }
+
+    return true;
+}
+
+static int bench_strcmp(void const* a, void const* b)
+{
+    return strcmp(*(char const* const*)a, *(char const* const*)b);
+}
+
+static glob_result_t const* bench_sorted;
+
+static int bench_path_compare(void const* a, void const* b)
+{
+    return glob_result_path_compare(bench_sorted, *(size_t const*)a, *(size_t const*)b);
+}
+
+static bool bench_run(size_t count)
+{
+    glob_result_t result;
+    glob_result_init(&result);
+    if (!bench_result_build(&result, count))
+        return false;
+
+    // qsort() and strcmp() on the paths built one by one
+    double start = bench_seconds();
+    plst_t paths;
+    plst_init(&paths);
+    if (!glob_result_paths_append(&result, 0, result.file_count, &paths))
+        return false;
+    qsort(paths.ptr, paths.len, sizeof(plst_item_t), bench_strcmp);
+    double qsort_paths = bench_seconds() - start;
+
+    // qsort() comparing the compact paths
+    start = bench_seconds();
+    size_t* order = malloc(result.file_count * sizeof(size_t));
+    if (!order)
+        return false;
+    for (size_t i = 0; i < result.file_count; ++i)
+        order[i] = i;
+    bench_sorted = &result;
+    qsort(order, result.file_count, sizeof(size_t), bench_path_compare);
+    double qsort_compact = bench_seconds() - start;
+    free(order);
+
+    // the multikey quicksort, which also drops repeated paths
+    start = bench_seconds();
+    if (!glob_result_sort_by_tag(&result, 1))
+        return false;
+    double multikey = bench_seconds() - start;
+
+    // the same order as strcmp(), the repeated paths aside
+    bool is_same = true;
+    plst_len_t j = 0;
+    for (size_t i = 0; is_same && i < result.file_count; ++i, ++j)
+    {
+        while (j > 0 && j < paths.len && strcmp(paths.ptr[j - 1], paths.ptr[j]) == 0)
+            ++j;
+
+        char path[glob_result_path_len(&result, i) + 1];
+        glob_result_path_copy(&result, i, path);
+        is_same = j < paths.len && strcmp(path, paths.ptr[j]) == 0;
+    }
+
+    printf("%8zu paths: multikey %.3f s, qsort built paths %.3f s, qsort compact %.3f s%s\n",
+        count, multikey, qsort_paths, qsort_compact, is_same ? "" : " (ORDER DIFFERS)");
+
+    plst_term(&paths, (plst_item_term_func_t)free);
+    glob_result_term(&result);
+    return is_same;
+}
+
+int main(int argc, char **argv)
+{
+    size_t const counts[] = { 100000, 300000, 1000000 };
+
+    bool result = true;
+    if (argc < 2)
+    {
+        for (size_t i = 0; result && i < sizeof(counts) / sizeof(counts[0]); ++i)
+            result = bench_run(counts[i]);
+    }
+
+    for (int i = 1; result && i < argc; ++i)
+        result = bench_run(strtoul(argv[i], 0, 10));
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
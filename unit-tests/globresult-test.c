@@ -0,0 +1,125 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// builds two results, merges them and checks the paths built back, the dropping of
+// empty directories, the grouping by tag and the sorting
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globresult.h"
+
+static int failures = 0;
+
+static void check_path(glob_result_t const* result, size_t file, char const* expected)
+{
+    char path[glob_result_path_len(result, file) + 1];
+    glob_result_path_copy(result, file, path);
+
+    if (strlen(expected) != glob_result_path_len(result, file) || strcmp(path, expected) != 0)
+    {
+        printf("file %zu: '%s' expected '%s'\n", file, path, expected);
+        ++failures;
+    }
+}
+
+int main(void)
+{
+    glob_result_t a;
+    glob_result_init(&a);
+
+    int root = glob_result_dir_push(&a, -1, "src", 3);
+    glob_result_file_push(&a, root, 1, "a.c", 3);
+    int sub = glob_result_dir_push(&a, root, "lib", 3);
+    glob_result_file_push(&a, sub, 0, "b.c", 3);
+
+    // a directory without matches takes no space
+    size_t names_size = a.names_size;
+    int empty = glob_result_dir_push(&a, root, "empty", 5);
+    glob_result_dir_drop_if_empty(&a, empty);
+    if (a.dir_count != 2 || a.names_size != names_size)
+    {
+        printf("empty directory kept\n");
+        ++failures;
+    }
+
+    glob_result_t b;
+    glob_result_init(&b);
+    int walked = glob_result_dir_push(&b, -1, "./x/y", 5);
+    glob_result_file_push(&b, walked, 0, "z.o", 3);
+    glob_result_file_push(&b, walked, 0, "w.o", 3);
+
+    // only the second file of 'b', retagged
+    size_t order[] = { 1 };
+    if (!glob_result_merge(&a, &b, order, 1, 1))
+        return EXIT_FAILURE;
+
+    check_path(&a, 0, "src/a.c");
+    check_path(&a, 1, "src/lib/b.c");
+    check_path(&a, 2, "./x/y/w.o");
+
+    if (glob_result_path_compare(&a, 0, 1) >= 0 || glob_result_path_compare(&a, 2, 0) >= 0)
+    {
+        printf("wrong order of paths\n");
+        ++failures;
+    }
+
+    size_t firsts[3];
+    if (!glob_result_group_by_tag(&a, 2, firsts))
+        return EXIT_FAILURE;
+
+    if (firsts[0] != 0 || firsts[1] != 1 || firsts[2] != 3)
+    {
+        printf("tag ranges %zu %zu %zu\n", firsts[0], firsts[1], firsts[2]);
+        ++failures;
+    }
+
+    check_path(&a, 0, "src/lib/b.c");
+    check_path(&a, 1, "src/a.c");
+    check_path(&a, 2, "./x/y/w.o");
+
+    plst_t paths;
+    plst_init(&paths);
+    if (!glob_result_paths_append(&a, 1, 2, &paths) || paths.len != 2 || strcmp(paths.ptr[1], "./x/y/w.o") != 0)
+    {
+        printf("paths not appended\n");
+        ++failures;
+    }
+
+    plst_term(&paths, (plst_item_term_func_t)free);
+
+    // sorted by the whole paths: 'lib.c' comes before the files of 'lib/', as '.' < '/';
+    // the repeated path is dropped, the tags stay apart
+    glob_result_t c;
+    glob_result_init(&c);
+    int c_root = glob_result_dir_push(&c, -1, "src", 3);
+    int c_lib = glob_result_dir_push(&c, c_root, "lib", 3);
+    glob_result_file_push(&c, c_lib, 0, "b.c", 3);
+    glob_result_file_push(&c, c_root, 0, "lib.c", 5);
+    glob_result_file_push(&c, c_root, 1, "z.c", 3);
+    glob_result_file_push(&c, c_lib, 0, "a_file_with_a_long_name.c", 25);
+    glob_result_file_push(&c, c_root, 0, "a.c", 3);
+    int c_again = glob_result_dir_push(&c, -1, "src/lib", 7);
+    glob_result_file_push(&c, c_again, 0, "b.c", 3);
+    glob_result_file_push(&c, c_root, 1, "y.c", 3);
+
+    if (!glob_result_sort_by_tag(&c, 2))
+        return EXIT_FAILURE;
+
+    char const* sorted[] = { "src/a.c", "src/lib.c", "src/lib/a_file_with_a_long_name.c", "src/lib/b.c", "src/y.c", "src/z.c" };
+    if (c.file_count != sizeof(sorted) / sizeof(sorted[0]))
+    {
+        printf("%zu files after sorting\n", c.file_count);
+        ++failures;
+    }
+    for (size_t i = 0; i < c.file_count && i < sizeof(sorted) / sizeof(sorted[0]); ++i)
+        check_path(&c, i, sorted[i]);
+
+    glob_result_term(&c);
+    glob_result_term(&b);
+    glob_result_term(&a);
+
+    printf("%d failures\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -4,14 +4,37 @@
 #include "lexer.h"
 #include "token.h"
 #include <stdio.h>
+#include <string.h>
 
 //char CMD1[] = "cd ..";
 //char CMD2[] = "foo bar < baz | quux *.txt > spam";
 
 int test(char const* cmd);
+int check(char const* cmd, char const* const* expected);
 
 int main(int argc, char **argv)
 {
+    // with no arguments the lexer is checked against the expected PATH tokens; the long
+    // line makes the delimiter scan cross several 16 character blocks
+    if (argc < 2)
+    {
+        char const* plain[] = { "foo", "bar", "baz", "quux", "*.txt", "spam", 0 };
+        char const* escapes[] = { "a b", "<x", "a&b|c", "x\\y", "\\q", "end\\", 0 };
+        char const* lone[] = { "&x", "c", "ex", 0 };
+        char const* hash[] = { "hashes", "x", "hash\\", 0 };
+        char const* long_path[] = { "/a/very/long/directory/name/that/spans/blocks/file.c", "tail with space", 0 };
+
+        int failures = 0;
+        failures += !check("foo bar < baz | quux *.txt > spam", plain);
+        failures += !check("a\\ b \\<x a\\&b\\|c x\\\\y \\q end\\", escapes);
+        failures += !check("&x c ex", lone);
+        failures += !check("hash hashes|hash>x hash\\\\", hash);
+        failures += !check("/a/very/long/directory/name/that/spans/blocks/file.c tail\\ with\\ space", long_path);
+
+        printf("%d failures\n", failures);
+        return failures ? 1 : 0;
+    }
+
     for(int i = 1; i < argc; i++)
     {
         char const* a = argv[i];
@@ -44,9 +67,44 @@ int test(char const* cmd)
         }
 
         char const* ts = token_type_to_str(t.token_type);
-        printf("'%s' - %s\n", t.token_text.ptr, ts);
+        printf("'%.*s' - %s\n", t.len, t.ptr, ts);
         cur = next;
     }
 
     return 1;
-}
\ No newline at end of file
+}
+
+// the PATH tokens of 'cmd' must be 'expected', other tokens are skipped
+int check(char const* cmd, char const* const* expected)
+{
+    token_t t;
+    token_init(&t);
+
+    int result = 1;
+    char const* cur = cmd;
+    while(result)
+    {
+        cur = lexer(cur, &t);
+        if(t.token_type == TOKEN_EOF)
+            break;
+
+        if(t.token_type != TOKEN_PATH)
+            continue;
+
+        if(!*expected || (size_t)t.len != strlen(*expected) || memcmp(t.ptr, *expected, t.len) != 0)
+        {
+            printf("'%s': '%.*s' expected '%s'\n", cmd, t.len, t.ptr, *expected ? *expected : "<none>");
+            result = 0;
+        }
+        ++expected;
+    }
+
+    if(result && *expected)
+    {
+        printf("'%s': '%s' not found\n", cmd, *expected);
+        result = 0;
+    }
+
+    token_term(&t);
+    return result;
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// compiles command lines and checks their instructions and jump targets, then runs a
+// few chains of 'true' and 'false' and checks their status, then checks the pipelines
+// the optimizer rewrites
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "program.h"
+#include "optimizer.h"
+#include "pathcache.h"
+
+static int failures = 0;
+
+// 'expected' has a letter per instruction: 'p' a pipeline of that many commands
+// given by the digit before it, 'f' a jump if failed and 's' a jump if succeeded,
+// followed by the target, e.g. "1p f4 1p s5 1p"
+static void check_code(char const* line, char const* expected)
+{
+    arena_t arena;
+    arena_init(&arena);
+
+    char buf[256];
+    size_t len = 0;
+    buf[0] = 0;
+
+    program_t* program = parse_command_line(line, &arena);
+    for (dlst_len_t i = 0; program && i < program->code.len; ++i)
+    {
+        program_instr_t* instr = dlst_at(&program->code, i);
+        switch (instr->op)
+        {
+            case PROGRAM_OP_PIPELINE:
+                len += snprintf(buf + len, sizeof(buf) - len, "%s%dp", i ? " " : "", instr->pipeline.len);
+                break;
+            case PROGRAM_OP_JUMP_IF_FAILED:
+                len += snprintf(buf + len, sizeof(buf) - len, " f%d", instr->target);
+                break;
+            case PROGRAM_OP_JUMP_IF_SUCCEEDED:
+                len += snprintf(buf + len, sizeof(buf) - len, " s%d", instr->target);
+                break;
+        }
+    }
+
+    if (!program || strcmp(buf, expected) != 0)
+    {
+        printf("'%s': '%s' expected '%s'\n", line, buf, expected);
+        ++failures;
+    }
+
+    arena_term(&arena);
+}
+
+// 'expected' is the program printed after the rewrites
+static void check_optimized(char const* line, char const* expected)
+{
+    arena_t arena;
+    arena_init(&arena);
+
+    char buf[512] = "";
+    program_t* program = parse_command_line(line, &arena);
+    if (program)
+    {
+        optimizer_run(program);
+
+        FILE* out = fmemopen(buf, sizeof(buf), "w");
+        program_print(program, out);
+        fclose(out);
+    }
+
+    if (!program || strcmp(buf, expected) != 0)
+    {
+        printf("'%s': '%s' expected '%s'\n", line, buf, expected);
+        ++failures;
+    }
+
+    arena_term(&arena);
+}
+
+static void check_status(char const* line, bool is_success)
+{
+    arena_t arena;
+    arena_init(&arena);
+
+    command_exec_status_t exec_status = { .code = 0, .exit = false };
+    program_t* program = parse_command_line(line, &arena);
+    if (!program || !program_exec(program, &exec_status) || (exec_status.code == 0) != is_success)
+    {
+        printf("'%s': status %d\n", line, exec_status.code);
+        ++failures;
+    }
+
+    arena_term(&arena);
+}
+
+int main(void)
+{
+    check_code("a", "1p");
+    check_code("a | b | c", "3p");
+    check_code("a && b || c", "1p f4 1p s5 1p");
+    check_code("a && b && c || d", "1p f6 1p f6 1p s7 1p");
+    check_code("a || b | c && d", "1p s4 2p f5 1p");
+
+    check_status("true", true);
+    check_status("false", false);
+    check_status("false && true", false);
+    check_status("false && true || true", true);
+    check_status("true && false || false && true", false);
+    check_status("false || false || true && true", true);
+    check_status("true || false && false", false);
+
+    char file[] = "/tmp/program-test-XXXXXX";
+    int fd = mkstemp(file);
+    if (fd == -1)
+        return EXIT_FAILURE;
+    close(fd);
+
+    char line[256];
+    char expected[256];
+
+    snprintf(line, sizeof(line), "cat %s | wc -l", file);
+    snprintf(expected, sizeof(expected), "0: run 'wc' '-l' < '%s'\n", file);
+    check_optimized(line, expected);
+
+    snprintf(line, sizeof(line), "cat < %s | cat | sort > out && cat %s | cd", file, file);
+    snprintf(expected, sizeof(expected), "0: run 'sort' < '%s' > 'out'\n1: jump if failed to 3\n2: run 'cat' '%s' | 'cd'\n", file, file);
+    check_optimized(line, expected);
+
+    snprintf(line, sizeof(line), "cat -n %s | wc", file);
+    snprintf(expected, sizeof(expected), "0: run 'cat' '-n' '%s' | 'wc'\n", file);
+    check_optimized(line, expected);
+
+    check_optimized("cat /nonexistent/file | wc", "0: run 'cat' '/nonexistent/file' | 'wc'\n");
+
+    unlink(file);
+    path_cache_term();
+
+    printf("%d failures\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
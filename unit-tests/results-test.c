@@ -0,0 +1,81 @@
+// Copyright (c) 2023 Egor Kosmachev
+// Licensed under the MIT license.
+
+// writes error lines to a pipe and checks how their text is escaped as a JSON string,
+// then closes the reader and checks the shell is not stopped by SIGPIPE
+
+#include "results.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct case_s
+{
+    char const* text;
+    char const* expected;   // the JSON string
+}
+case_t;
+
+static case_t const cases[] =
+{
+    { "plain",                      "\"plain\"" },
+    { "",                           "\"\"" },
+    { "a \"b\" c\\d",               "\"a \\\"b\\\" c\\\\d\"" },
+    { "a\nb\tc\x01" "d\x1f",        "\"a\\nb\\tc\\u0001d\\u001f\"" },
+    { "caf\xc3\xa9 \xf0\x9f\x98\x80", "\"caf\xc3\xa9 \xf0\x9f\x98\x80\"" },
+    { "a\xff" "b",                  "\"a\\u00ffb\"" },
+    { "\xed\xa0\x80",               "\"\\u00ed\\u00a0\\u0080\"" },
+    { "\xc0\xaf",                   "\"\\u00c0\\u00af\"" },
+    { "\xf4\x90\x80\x80",           "\"\\u00f4\\u0090\\u0080\\u0080\"" },
+    { "x\xc3",                      "\"x\\u00c3\"" },
+    { "\xe2\x82" "a",               "\"\\u00e2\\u0082a\"" },
+};
+
+int main(void)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        case_t const* c = &cases[i];
+
+        int fds[2];
+        if (pipe(fds) == -1 || !results_open(fds[1]))
+            return EXIT_FAILURE;
+
+        results_line_error(1, c->text);
+        results_close();
+        close(fds[1]);
+
+        char buf[256];
+        ssize_t len = read(fds[0], buf, sizeof(buf) - 1);
+        close(fds[0]);
+        buf[len > 0 ? len : 0] = '\0';
+
+        char expected[256];
+        snprintf(expected, sizeof(expected), "{\"line\":1,\"status\":-1,\"error\":%s,\"pipelines\":[]}\n", c->expected);
+
+        bool is_ok = strcmp(buf, expected) == 0;
+        printf("%s %s", is_ok ? "ok  " : "FAIL", buf);
+        if (!is_ok)
+            ++failed;
+    }
+
+    // the reader went away: the write fails instead of raising SIGPIPE, and the results
+    // are not written any more
+    int fds[2];
+    if (pipe(fds) == -1 || !results_open(fds[1]))
+        return EXIT_FAILURE;
+
+    close(fds[0]);
+    results_line_error(1, "gone");
+    results_flush();
+
+    bool is_ok = !results_is_enabled();
+    printf("%s closed reader\n", is_ok ? "ok  " : "FAIL");
+    if (!is_ok)
+        ++failed;
+
+    close(fds[1]);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}